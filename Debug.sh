@@ -14,8 +14,7 @@ PAR[9]="1e-10" #Error
 fname=GL"${PAR[1]}"_D"${PAR[2]}"_U"${PAR[3]}"_E"${PAR[4]}"_Phi"${PAR[5]}"Pi_B"${PAR[6]}"_Beta"${PAR[7]}" # CREATE PART OF FILENAME
 
 rm dat*.sh 
-echo "time nice -n 19 valgrind --leak-check=yes ./bin/run " >> dat_$fname.sh
-#\"${PAR[1]}\" \"${PAR[2]}\" \"${PAR[3]}\" \"${PAR[4]}\" \"${PAR[5]}\" \"${PAR[6]}\" \"${PAR[7]}\" \"$fname.dat\" \"${PAR[9]}\" 
+echo "time nice -n 19 valgrind --leak-check=yes ./bin/run \"${PAR[1]}\" \"${PAR[2]}\" \"${PAR[3]}\" \"${PAR[4]}\" \"${PAR[5]}\" \"${PAR[6]}\" \"${PAR[7]}\" \"$fname.dat\" \"${PAR[9]}\" " >> dat_$fname.sh
 chmod a+x dat_$fname.sh
 ./dat_$fname.sh
 
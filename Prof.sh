@@ -16,8 +16,7 @@ fname=GL"${PAR[1]}"_D"${PAR[2]}"_U"${PAR[3]}"_E"${PAR[4]}"_Phi"${PAR[5]}"Pi_B"${
 
 rm dat*.sh #dat${name[$i]}$fname.sh
 echo "rm callgrind.out.*" >> dat_$fname.sh
-echo "time nice -n 19 valgrind --tool=callgrind ./bin/run " >> dat_$fname.sh
-#\"${PAR[1]}\" \"${PAR[2]}\" \"${PAR[3]}\" \"${PAR[4]}\" \"${PAR[5]}\" \"${PAR[6]}\" \"${PAR[7]}\" \"$fname.dat\" \"${PAR[9]}\" 
+echo "time nice -n 19 valgrind --tool=callgrind ./bin/run \"${PAR[1]}\" \"${PAR[2]}\" \"${PAR[3]}\" \"${PAR[4]}\" \"${PAR[5]}\" \"${PAR[6]}\" \"${PAR[7]}\" \"$fname.dat\" \"${PAR[9]}\" " >> dat_$fname.sh
 echo "callgrind_annotate --auto=yes callgrind.out.* >> annot_src.cpp" >> dat_$fname.sh
 echo "kcachegrind callgrind.out.* &" >> dat_$fname.sh
 chmod a+x dat_$fname.sh
@@ -0,0 +1,257 @@
+// Micro-benchmarks of the arithmetic_tuple operators, the norms, gf initialization, full controlled Cash-Karp
+// steps and the bubble sums for a sweep of the number of Matsubara frequencies N. One CSV line per benchmark and N:
+//   bench,N,elements,ns_per_elem,GB_per_s,allocs_per_iter,bytes_alloc_per_iter
+// elements counts the gf elements of one state, GB/s is based on the minimal memory traffic of the operation.
+
+#include <new>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <complex>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+
+#include <boost/numeric/odeint.hpp>
+
+#include <gf_state.h>
+#include <gf_conv.h>
+
+using namespace ReaK;
+
+/********************* Allocation counting  ********************/
+
+static std::size_t alloc_count = 0;
+static std::size_t alloc_bytes = 0;
+
+// All forms of the global new and delete are replaced together, such that every allocation is counted and
+// released by the matching function ( the aligned forms only exist from C++17 on ). The deletes are kept out
+// of line, otherwise g++ sees free() applied to the result of operator new and warns ( -Wmismatched-new-delete )
+static void* counted_malloc( const std::size_t bytes ) noexcept
+{
+   ++alloc_count;
+   alloc_bytes += bytes;
+   return std::malloc( bytes > 0 ? bytes : 1 );
+}
+
+void* operator new( std::size_t bytes )
+{
+   if( void* p = counted_malloc( bytes ) )
+      return p;
+   throw std::bad_alloc();
+}
+void* operator new[]( std::size_t bytes )
+{
+   if( void* p = counted_malloc( bytes ) )
+      return p;
+   throw std::bad_alloc();
+}
+void* operator new( std::size_t bytes, const std::nothrow_t& ) noexcept { return counted_malloc( bytes ); }
+void* operator new[]( std::size_t bytes, const std::nothrow_t& ) noexcept { return counted_malloc( bytes ); }
+__attribute__(( noinline )) void operator delete( void* p ) noexcept { std::free( p ); }
+__attribute__(( noinline )) void operator delete[]( void* p ) noexcept { std::free( p ); }
+__attribute__(( noinline )) void operator delete( void* p, std::size_t ) noexcept { std::free( p ); }
+__attribute__(( noinline )) void operator delete[]( void* p, std::size_t ) noexcept { std::free( p ); }
+__attribute__(( noinline )) void operator delete( void* p, const std::nothrow_t& ) noexcept { std::free( p ); }
+__attribute__(( noinline )) void operator delete[]( void* p, const std::nothrow_t& ) noexcept { std::free( p ); }
+
+/********************* States of the flow with a runtime number of frequencies  ********************/
+
+// The state and stepper types are those of the flow, see gf_state.h. The storage follows the build flags
+int N = 50; 		// Number of Matsubara frequencies of the current sweep point
+int N_eff = 50;
+int N_sparse = 0;
+
+// Vertex in single precision, as stored by builds with GF_FLOAT
+using gf_2p_float_t = gf_2p_tmpl_t< std::complex< float > >;
+using state_float_t = state_tmpl_t< gf_2p_float_t >;
+
+template< typename State >
+std::size_t num_elements( const State& x ) { return x.Sig().num_elements() + x.Gam().num_elements(); }
+
+template< typename State >
+std::size_t num_bytes( const State& x )
+{
+   return x.Sig().num_elements() * sizeof( typename State::Sig_t::element ) + x.Gam().num_elements() * sizeof( typename State::Gam_t::element );
+}
+
+// Cheap rhs, such that the benchmark of the step measures the stepper and the algebra
+struct rhs_t
+{
+   template< typename State >
+   void operator()( const State&, State& dxdt, const double ) const
+   {
+      init_parallel( std::get<0>( dxdt ), []( const gf_1p_t::idx_t& )->double{ return 1.0; } );
+      using gf_2p = typename std::decay< decltype( std::get<1>( dxdt ) ) >::type;
+      init_parallel( std::get<1>( dxdt ), []( const typename gf_2p::idx_t& )->double{ return 1.0; } );
+   }
+};
+
+/********************* Measurement  ********************/
+
+struct result_t
+{
+   double ns_per_iter;
+   double allocs_per_iter;
+   double bytes_per_iter;
+};
+
+// Minimum time over several trials, the repetitions are chosen such that a trial takes about 20 ms
+inline result_t measure( const std::function< void() >& func )
+{
+   using clock_t = std::chrono::steady_clock;
+   func();
+
+   std::size_t reps = 1;
+   for( ;; )
+   {
+      const auto start = clock_t::now();
+      for( std::size_t i = 0; i < reps; ++i )
+	 func();
+      const double sec = std::chrono::duration< double >( clock_t::now() - start ).count();
+      if( sec > 0.02 || reps > ( 1u << 24 ) )
+	 break;
+      reps *= 2;
+   }
+
+   double best = 1e300;
+   std::size_t allocs = 0, bytes = 0;
+   for( int trial = 0; trial < 5; ++trial )
+   {
+      const std::size_t count0 = alloc_count, bytes0 = alloc_bytes;
+      const auto start = clock_t::now();
+      for( std::size_t i = 0; i < reps; ++i )
+	 func();
+      best = std::min( best, std::chrono::duration< double, std::nano >( clock_t::now() - start ).count() / reps );
+      allocs = alloc_count - count0;
+      bytes = alloc_bytes - bytes0;
+   }
+   return result_t{ best, double( allocs ) / reps, double( bytes ) / reps };
+}
+
+inline void report( const char* name, const std::size_t elements, const double bytes_moved, const result_t& res )
+{
+   std::printf( "%s,%d,%zu,%.4f,%.3f,%.2f,%.0f\n", name, N, elements, res.ns_per_iter / elements, bytes_moved / res.ns_per_iter, res.allocs_per_iter, res.bytes_per_iter );
+   std::fflush( stdout );
+}
+
+// Full controlled Cash-Karp steps of the flow's stepper, the step size is reset such that every step does the same work.
+// Approximate traffic: six stages reading up to six states each, the solution, the error estimate and its norm
+template< typename Stepper, typename State >
+inline result_t measure_cash_karp_step( State& x )
+{
+   rhs_t rhs;
+   Stepper stepper( typename Stepper::error_checker_type( 1e-2, 1e-2 ) );
+   double t = 0.0;
+   return measure( [&](){
+	 double dt = 1e-3;
+	 stepper.try_step( rhs, x, t, dt ); } );
+}
+
+int main( int argc, char** argv )
+{
+   using namespace boost::numeric::odeint;
+
+   std::vector< int > sweep = { 50, 100, 200, 400, 800 };
+   if( argc > 1 )
+   {
+      sweep.clear();
+      for( int i = 1; i < argc; ++i )
+	 sweep.push_back( std::atoi( argv[i] ) );
+   }
+
+   std::printf( "bench,N,elements,ns_per_elem,GB_per_s,allocs_per_iter,bytes_alloc_per_iter\n" );
+
+   for( const int n : sweep )
+   {
+      N = n;
+      state_t x, y, z;
+      const std::size_t elements = num_elements( x );
+      const double bytes = num_bytes( x );
+
+      report( "gf_init", elements, 2 * bytes, measure( [&](){
+	       std::get<0>( x ).init( []( const gf_1p_t::idx_t& )->dcomplex{ return 1.1; } );
+	       std::get<1>( x ).init( []( const gf_2p_t::idx_t& )->Gam_value_t{ return 1.2; } ); } ) );
+
+      report( "gf_init_parallel", elements, 2 * bytes, measure( [&](){
+	       init_parallel( std::get<0>( y ), []( const gf_1p_t::idx_t& )->dcomplex{ return 0.5; } );
+	       init_parallel( std::get<1>( y ), []( const gf_2p_t::idx_t& )->Gam_value_t{ return 0.5; } ); } ) );
+
+      // Row- and tile-wise initialization, no index is decoded per element
+      report( "gf_init_rows", elements, 2 * bytes, measure( [&](){
+	       init_rows( std::get<0>( y ), []( const gf_row_t< gf_1p_t >& row ){ for( int j = 0; j < row.len; ++j ) row[j] = 0.5; } );
+	       init_rows( std::get<1>( y ), []( const gf_row_t< gf_2p_t >& row ){ for( int j = 0; j < row.len; ++j ) row[j] = 0.5; } ); } ) );
+
+      report( "gf_init_tiles", elements, 2 * bytes, measure( [&](){
+	       init_rows( std::get<0>( y ), []( const gf_row_t< gf_1p_t >& row ){ for( int j = 0; j < row.len; ++j ) row[j] = 0.5; } );
+	       init_tiles( std::get<1>( y ), []( const gf_tile_t< gf_2p_t >& tile ){
+		  for( int i = 0; i < tile.n_W; ++i )
+		     for( int j = 0; j < tile.n_w; ++j )
+			tile( i, j ) = 0.5; } ); } ) );
+
+      // Lazy expressions are evaluated on interleaved double elements, see arithmetic_tuple.h
+#if !defined(GF_FLOAT) && !defined(GF_SOA)
+      report( "tuple_add", elements, 3 * bytes, measure( [&](){ z = x + y; } ) );
+      report( "tuple_axpy", elements, 3 * bytes, measure( [&](){ z = x + 0.5 * y; } ) );
+      report( "tuple_scale_sum3", elements, 3 * bytes, measure( [&](){ z = 0.3 * x + 0.2 * y - 0.1 * z; } ) );
+#endif
+      report( "tuple_add_assign", elements, 3 * bytes, measure( [&](){ z += y; } ) );
+      report( "tuple_copy", elements, 2 * bytes, measure( [&](){ state_t w( x ); } ) );
+
+      double res = 0.0;
+      report( "tuple_norm", elements, bytes, measure( [&](){ res += norm( x ); } ) );
+      report( "gf_algebra_norm_inf", elements, bytes, measure( [&](){ res += state_algebra_t::norm_inf( x ); } ) );
+
+      // Error estimate of a trial step: default_error_checker ( weighted errors written, then their maximum norm )
+      // versus the single read-only pass of gf_error_checker
+      default_error_checker< double, state_algebra_t, gf_operations > default_checker( 1e-2, 1e-2 );
+      gf_error_checker< double, state_algebra_t, gf_operations > fused_checker( 1e-2, 1e-2 );
+      state_algebra_t algebra;
+      state_t err( z );
+      report( "error_default", elements, 5 * bytes, measure( [&](){ err = z; res += default_checker.error( algebra, x, y, err, 1e-3 ); } ) );
+      report( "error_fused", elements, 5 * bytes, measure( [&](){ err = z; res += fused_checker.error( algebra, x, y, err, 1e-3 ); } ) );
+
+      report( "cash_karp_step", elements, 40 * bytes, measure_cash_karp_step< controlled_stepper_t >( x ) );
+
+      report( "algebra_scale_sum3", elements, 4 * bytes, measure( [&](){ algebra.for_each4( z, x, y, z, gf_operations::scale_sum3<>( 0.3, 0.2, -0.1 ) ); } ) );
+
+      // Single-precision vertex ( not with the split storage of GF_SOA ), the algebra operates in double precision and only rounds the stored
+      // elements, such that the traffic of Gam is halved
+#ifndef GF_SOA
+      state_float_t xf, yf, zf;
+      for( state_float_t* s : { &xf, &yf, &zf } )
+      {
+	 std::get<0>( *s ).init( []( const gf_1p_t::idx_t& )->dcomplex{ return 1.1; } );
+	 std::get<1>( *s ).init( []( const gf_2p_float_t::idx_t& )->std::complex< float >{ return 1.2f; } );
+      }
+      const double bytes_float = num_bytes( xf );
+      report( "algebra_scale_sum3_float", elements, 4 * bytes_float, measure( [&](){ algebra.for_each4( zf, xf, yf, zf, gf_operations::scale_sum3<>( 0.3, 0.2, -0.1 ) ); } ) );
+      report( "cash_karp_step_float", elements, 40 * bytes_float, measure_cash_karp_step< cash_karp_stepper_tmpl_t< state_float_t > >( xf ) );
+#endif
+
+      // Bubble sum over the fermionic window for all bosonic W, direct O( N^2 ) against the FFTs of freq_conv_t.
+      // Per element of the bosonic output, traffic of the two operands
+      std::vector< dcomplex > f( 2 * N ), g( 2 * N ), bubble( 2 * N + 1 );
+      for( int n = -N; n < N; ++n )
+      {
+	 f[ n + N ] = 1.0 / dcomplex( 0.5, n + 0.5 );
+	 g[ n + N ] = 1.0 / dcomplex( -0.3, n + 0.5 );
+      }
+      freq_conv_t conv( N, N );
+      report( "bubble_direct", bubble.size(), 2 * f.size() * sizeof( dcomplex ), measure( [&](){
+	       for( int W = -N; W <= N; ++W )
+	       {
+		  dcomplex sum = 0.0;
+		  for( int n = std::max( -N, -N - W ); n < std::min( N, N - W ); ++n )
+		     sum += f[ n + N ] * g[ n + W + N ];
+		  bubble[ W + N ] = sum;
+	       } } ) );
+      report( "bubble_fft", bubble.size(), 2 * f.size() * sizeof( dcomplex ), measure( [&](){ conv.correlate( f.data(), g.data(), bubble.data() ); } ) );
+      res += bubble[N].real();
+
+      if( res < 0.0 )
+	 std::printf( "%f\n", res );
+   }
+}
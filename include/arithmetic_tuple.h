@@ -7,6 +7,10 @@
  * of the support for all the basic arithmetic operators, requiring, of course, that these 
  * arithmetic operators are also available on all the types contained in the tuple.
  * 
+ * The non-assigning operators return lazy expression templates, which are evaluated 
+ * element-wise in a single pass when assigned to an arithmetic-tuple. This requires the 
+ * tuple elements to provide contiguous storage through data() and num_elements().
+ * 
  * \author Sven Mikael Persson <mikael.s.persson@gmail.com>
  * \date September 2011
  */
@@ -36,6 +40,10 @@
 #pragma once
 
 #include <tuple>
+#include <complex>
+#include <cstddef>
+#include <utility>
+#include <algorithm>
 
 #include <boost/type_traits.hpp>
 #include <boost/utility/enable_if.hpp>
@@ -46,6 +54,8 @@
 #include <boost/mpl/greater.hpp>
 #include <boost/mpl/equal_to.hpp>
 #include <boost/mpl/prior.hpp>
+#include <boost/mpl/not.hpp>
+#include <boost/mpl/if.hpp>
 
 namespace ReaK {
 
@@ -84,6 +94,34 @@ namespace ReaK {
    //struct arithmetic_tuple_size : 
    //boost::mpl::size_t< 0 > { };
 
+   /**
+    * This class template is the base of all lazy arithmetic-tuple expressions (CRTP). 
+    * Expressions are created by the arithmetic operators and evaluated upon assignment to an arithmetic-tuple.
+    * \tparam Expr The derived expression type.
+    */
+   template <typename Expr>
+      class arithmetic_tuple_expr {
+	 public:
+	    inline const Expr& self() const { return static_cast< const Expr& >( *this ); };
+      };
+
+   /**
+    * This meta-function computes a bool integral constant if the given type is an arithmetic-tuple expression.
+    * \tparam T The type to be tested.
+    */
+   template <typename T>
+      struct is_arithmetic_tuple_expr : 
+	 boost::is_base_of< arithmetic_tuple_expr< T >, T > { };
+
+   /* True if the (forwarded) argument list consists of a single arithmetic-tuple expression. */
+   template <typename... U>
+      struct is_single_arithmetic_tuple_expr : 
+	 false_type { };
+
+   template <typename U>
+      struct is_single_arithmetic_tuple_expr< U > : 
+	 is_arithmetic_tuple_expr< typename std::decay< U >::type > { };
+
    /**
     * This class template is a simple wrapper of a tuple with the addition of arithmetic operators. 
     * This class is basically just a wrapper of the std::tuple class, and it provides 
@@ -103,7 +141,8 @@ namespace ReaK {
 
 	    explicit arithmetic_tuple( const double val ) : base_t() { };
 
-	    template <typename... U>
+	    template <typename... U, 
+		     typename = typename boost::disable_if< is_single_arithmetic_tuple_expr< U... > >::type >
 	       explicit arithmetic_tuple(U&&... u) : base_t(std::forward<U>(u)...) { };
 
 
@@ -127,6 +166,13 @@ namespace ReaK {
 	       return *this; 
 	    } 
 
+	    /* Evaluates the expression in a single pass over the storage of each element. */
+	    template <typename Expr>
+	       arithmetic_tuple( const arithmetic_tuple_expr< Expr >& expr );
+
+	    template <typename Expr>
+	       arithmetic_tuple< T...>& operator=( const arithmetic_tuple_expr< Expr >& expr );
+
       };
 
    /* Specialization, see general template docs. */
@@ -323,245 +369,230 @@ namespace ReaK {
 
 
 
-      template <typename Idx, typename Tuple>
-	 inline 
-	 typename boost::enable_if< 
-	 boost::mpl::equal_to< 
-	 Idx, 
-	 boost::mpl::size_t<0> 
-	    >,
-	 void >::type tuple_add_impl( Tuple& result, const Tuple& lhs, const Tuple& rhs) { };
+      /*****************************************************************************************
+	Expression-template implementation details
+       *****************************************************************************************/
 
-      template <typename Idx, typename Tuple>
-	 inline 
-	 typename boost::enable_if< 
-	 boost::mpl::greater< 
-	 Idx, 
-	 boost::mpl::size_t<0> 
-	    >,
-	 void >::type tuple_add_impl( Tuple& result, const Tuple& lhs, const Tuple& rhs) {
-	    tuple_add_impl<typename boost::mpl::prior<Idx>::type,Tuple>(result,lhs,rhs);
-	    get<boost::mpl::prior<Idx>::type::value>(result) = get<boost::mpl::prior<Idx>::type::value>(lhs) + get<boost::mpl::prior<Idx>::type::value>(rhs);
-
-	    //std::cout << " performing addition at level " << boost::mpl::prior<Idx>::type::value << std::endl; 
-
-	    //if( boost::mpl::prior<Idx>::type::value == 2 )
-	    //{
-	       //std::cout << " adding lhs " << get<boost::mpl::prior<Idx>::type::value>(lhs)(2639) << std::endl; 
-	       //std::cout << " with rhs " << get<boost::mpl::prior<Idx>::type::value>(rhs)(2639) << std::endl; 
-	       //std::cout << " result " << get<boost::mpl::prior<Idx>::type::value>(rhs)(2639) << std::endl; 
-	    //}
-	 };
+      /* Element-wise operations carried by the expression nodes. */
+      struct tuple_expr_add {
+	 template <typename A, typename B>
+	    static inline auto apply( const A& a, const B& b ) -> decltype( a + b ) { return a + b; };
+      };
 
-      template <typename Idx, typename Tuple>
-	 inline 
-	 typename boost::enable_if< 
-	 boost::mpl::equal_to< 
-	 Idx, 
-	 boost::mpl::size_t<0> 
-	    >,
-	 void >::type tuple_sub_impl( Tuple& result, const Tuple& lhs, const Tuple& rhs) { };
+      struct tuple_expr_sub {
+	 template <typename A, typename B>
+	    static inline auto apply( const A& a, const B& b ) -> decltype( a - b ) { return a - b; };
+      };
 
-      template <typename Idx, typename Tuple>
-	 inline 
-	 typename boost::enable_if< 
-	 boost::mpl::greater< 
-	 Idx, 
-	 boost::mpl::size_t<0> 
-	    >,
-	 void >::type tuple_sub_impl( Tuple& result, const Tuple& lhs, const Tuple& rhs) {
-	    tuple_sub_impl<typename boost::mpl::prior<Idx>::type,Tuple>(result,lhs,rhs);
-	    get<boost::mpl::prior<Idx>::type::value>(result) = get<boost::mpl::prior<Idx>::type::value>(lhs) - get<boost::mpl::prior<Idx>::type::value>(rhs);
-	 };
+      struct tuple_expr_mul {
+	 template <typename A, typename B>
+	    static inline auto apply( const A& a, const B& b ) -> decltype( a * b ) { return a * b; };
+      };
 
-      template <typename Idx, typename Tuple>
-	 inline 
-	 typename boost::enable_if< 
-	 boost::mpl::equal_to< 
-	 Idx, 
-	 boost::mpl::size_t<0> 
-	    >,
-	 void >::type tuple_neg_impl( Tuple& result, const Tuple& lhs) { };
+      struct tuple_expr_div {
+	 template <typename A, typename B>
+	    static inline auto apply( const A& a, const B& b ) -> decltype( a / b ) { return a / b; };
+      };
 
-      template <typename Idx, typename Tuple>
-	 inline 
-	 typename boost::enable_if< 
-	 boost::mpl::greater< 
-	 Idx, 
-	 boost::mpl::size_t<0> 
-	    >,
-	 void >::type tuple_neg_impl( Tuple& result, const Tuple& lhs) {
-	    tuple_neg_impl<typename boost::mpl::prior<Idx>::type,Tuple>(result,lhs);
-	    get<boost::mpl::prior<Idx>::type::value>(result) = -get<boost::mpl::prior<Idx>::type::value>(lhs);
-	 };
+      struct tuple_expr_neg {
+	 template <typename A>
+	    static inline auto apply( const A& a ) -> decltype( -a ) { return -a; };
+      };
 
-      template <typename Idx, typename Tuple>
-	 inline 
-	 typename boost::enable_if< 
-	 boost::mpl::equal_to< 
-	 Idx, 
-	 boost::mpl::size_t<0> 
-	    >,
-	 void >::type tuple_mul_impl( Tuple& result, const Tuple& lhs, const Tuple& rhs) { };
+      struct tuple_expr_abs {
+	 template <typename A>
+	    static inline auto apply( const A& a ) -> decltype( abs( a ) ) { return abs( a ); };
+      };
 
-      template <typename Idx, typename Tuple>
-	 inline 
-	 typename boost::enable_if< 
-	 boost::mpl::greater< 
-	 Idx, 
-	 boost::mpl::size_t<0> 
-	    >,
-	 void >::type tuple_mul_impl( Tuple& result, const Tuple& lhs, const Tuple& rhs) {
-	    tuple_mul_impl<typename boost::mpl::prior<Idx>::type,Tuple>(result,lhs,rhs);
-	    get<boost::mpl::prior<Idx>::type::value>(result) = get<boost::mpl::prior<Idx>::type::value>(lhs) * get<boost::mpl::prior<Idx>::type::value>(rhs);
+      /* Element-wise assignments used when an expression is evaluated into a tuple. */
+      struct tuple_expr_assign {
+	 template <typename A, typename B>
+	    static inline void apply( A& a, const B& b ) { a = b; };
+      };
+
+      struct tuple_expr_addassign {
+	 template <typename A, typename B>
+	    static inline void apply( A& a, const B& b ) { a += b; };
+      };
+
+      struct tuple_expr_subassign {
+	 template <typename A, typename B>
+	    static inline void apply( A& a, const B& b ) { a -= b; };
+      };
+
+      /* 
+       * Evaluators of a single tuple element. They are bound to the raw contiguous storage 
+       * before the loop, such that the loop body only consists of the fused arithmetic.
+       */
+      template <typename T>
+	 struct tuple_expr_leaf_eval {
+	    const T* data;
+	    inline const T& operator[]( std::size_t i ) const { return data[i]; };
 	 };
 
-      template <typename Idx, typename Tuple>
-	 inline 
-	 typename boost::enable_if< 
-	 boost::mpl::equal_to< 
-	 Idx, 
-	 boost::mpl::size_t<0> 
-	    >,
-	 void >::type tuple_div_impl( Tuple& result, const Tuple& lhs, const Tuple& rhs) { };
+      template <typename S>
+	 struct tuple_expr_scalar_eval {
+	    S value;
+	    inline const S& operator[]( std::size_t ) const { return value; };
+	 };
 
-      template <typename Idx, typename Tuple>
-	 inline 
-	 typename boost::enable_if< 
-	 boost::mpl::greater< 
-	 Idx, 
-	 boost::mpl::size_t<0> 
-	    >,
-	 void >::type tuple_div_impl( Tuple& result, const Tuple& lhs, const Tuple& rhs) {
-	    tuple_div_impl<typename boost::mpl::prior<Idx>::type,Tuple>(result,lhs,rhs);
-	    get<boost::mpl::prior<Idx>::type::value>(result) = get<boost::mpl::prior<Idx>::type::value>(lhs) / get<boost::mpl::prior<Idx>::type::value>(rhs);
+      template <typename Op, typename LEval, typename REval>
+	 struct tuple_expr_binary_eval {
+	    LEval lhs;
+	    REval rhs;
+	    inline auto operator[]( std::size_t i ) const -> decltype( Op::apply( std::declval< const LEval& >()[i], std::declval< const REval& >()[i] ) ) { 
+	       return Op::apply( lhs[i], rhs[i] ); 
+	    };
 	 };
 
-      template <typename Idx, typename Tuple, typename Scalar>
-	 inline 
-	 typename boost::enable_if< 
-	 boost::mpl::equal_to< 
-	 Idx, 
-	 boost::mpl::size_t<0> 
-	    >,
-	 void >::type tuple_muls_impl( Tuple& result, const Tuple& lhs, const Scalar& rhs) { };
+      template <typename Op, typename Eval>
+	 struct tuple_expr_unary_eval {
+	    Eval arg;
+	    inline auto operator[]( std::size_t i ) const -> decltype( Op::apply( std::declval< const Eval& >()[i] ) ) { 
+	       return Op::apply( arg[i] ); 
+	    };
+	 };
 
-      template <typename Idx, typename Tuple, typename Scalar>
-	 inline 
-	 typename boost::enable_if< 
-	 boost::mpl::greater< 
-	 Idx, 
-	 boost::mpl::size_t<0> 
-	    >,
-	 void >::type tuple_muls_impl( Tuple& result, const Tuple& lhs, const Scalar& rhs) {
-	    tuple_muls_impl<typename boost::mpl::prior<Idx>::type,Tuple,Scalar>(result,lhs,rhs);
-	    get<boost::mpl::prior<Idx>::type::value>(result) = get<boost::mpl::prior<Idx>::type::value>(lhs) * rhs;
+      /* Operand categories of an expression node. */
+      struct tuple_expr_tuple_tag { };
+      struct tuple_expr_node_tag { };
+      struct tuple_expr_scalar_tag { };
+
+      template <typename T>
+	 struct tuple_expr_operand_tag {
+	    typedef typename boost::mpl::if_< is_arithmetic_tuple_expr< T >, tuple_expr_node_tag,
+		    typename boost::mpl::if_< is_instance_of_arithmetic_tuple< T >, tuple_expr_tuple_tag,
+		    typename boost::mpl::if_< is_scalar< T >, tuple_expr_scalar_tag, 
+		    void >::type >::type >::type type;
 	 };
 
-      template <typename Idx, typename Tuple, typename Scalar>
-	 inline 
-	 typename boost::enable_if< 
-	 boost::mpl::equal_to< 
-	 Idx, 
-	 boost::mpl::size_t<0> 
-	    >,
-	 void >::type tuple_smul_impl( Tuple& result, const Scalar& lhs, const Tuple& rhs) { };
+      template <typename T, typename Tag = typename tuple_expr_operand_tag< T >::type>
+	 struct tuple_expr_operand { };
 
-      template <typename Idx, typename Tuple, typename Scalar>
-	 inline 
-	 typename boost::enable_if< 
-	 boost::mpl::greater< 
-	 Idx, 
-	 boost::mpl::size_t<0> 
-	    >,
-	 void >::type tuple_smul_impl( Tuple& result, const Scalar& lhs, const Tuple& rhs) {
-	    tuple_smul_impl<typename boost::mpl::prior<Idx>::type,Tuple,Scalar>(result,lhs,rhs);
-	    get<boost::mpl::prior<Idx>::type::value>(result) = lhs * get<boost::mpl::prior<Idx>::type::value>(rhs);
+      /* Arithmetic-tuples are held by reference and evaluated on the storage of their elements. */
+      template <typename T>
+	 struct tuple_expr_operand< T, tuple_expr_tuple_tag > {
+	    typedef const T& storage_type;
+	    typedef T tuple_type;
+
+	    template <std::size_t K>
+	       struct eval {
+		  typedef typename std::remove_reference< decltype( get<K>( std::declval< const T& >() ) ) >::type element_type;
+		  typedef tuple_expr_leaf_eval< typename element_type::element > type;
+	       };
+
+	    template <std::size_t K>
+	       static inline typename eval<K>::type make( const T& t ) {
+		  typename eval<K>::type e = { get<K>( t ).data() };
+		  return e;
+	       };
+
+	    template <std::size_t K>
+	       static inline std::size_t size( const T& t ) { return get<K>( t ).num_elements(); };
 	 };
 
-      template <typename Idx, typename Tuple, typename Scalar>
-	 inline 
-	 typename boost::enable_if< 
-	 boost::mpl::equal_to< 
-	 Idx, 
-	 boost::mpl::size_t<0> 
-	    >,
-	 void >::type tuple_divs_impl( Tuple& result, const Tuple& lhs, const Scalar& rhs) { };
+      /* Nested expressions are held by value, they only contain references and scalars. */
+      template <typename T>
+	 struct tuple_expr_operand< T, tuple_expr_node_tag > {
+	    typedef T storage_type;
+	    typedef typename T::tuple_type tuple_type;
 
-      template <typename Idx, typename Tuple, typename Scalar>
-	 inline 
-	 typename boost::enable_if< 
-	 boost::mpl::greater< 
-	 Idx, 
-	 boost::mpl::size_t<0> 
-	    >,
-	 void >::type tuple_divs_impl( Tuple& result, const Tuple& lhs, const Scalar& rhs) {
-	    tuple_divs_impl<typename boost::mpl::prior<Idx>::type,Tuple,Scalar>(result,lhs,rhs);
-	    get<boost::mpl::prior<Idx>::type::value>(result) = get<boost::mpl::prior<Idx>::type::value>(lhs) / rhs;
+	    template <std::size_t K>
+	       struct eval {
+		  typedef typename T::template eval_type<K>::type type;
+	       };
+
+	    template <std::size_t K>
+	       static inline typename eval<K>::type make( const T& t ) { return t.template eval<K>(); };
+
+	    template <std::size_t K>
+	       static inline std::size_t size( const T& t ) { return t.template size<K>(); };
 	 };
 
-      template <typename Idx, typename Tuple, typename Scalar>
-	 inline 
-	 typename boost::enable_if< 
-	 boost::mpl::equal_to< 
-	 Idx, 
-	 boost::mpl::size_t<0> 
-	    >,
-	 void >::type tuple_adds_impl( Tuple& result, const Tuple& lhs, const Scalar& rhs) { };
+      /* Scalars are held by value, integers are promoted such that they mix with complex elements. */
+      template <typename T>
+	 struct tuple_expr_operand< T, tuple_expr_scalar_tag > {
+	    typedef typename boost::mpl::if_< boost::is_integral< T >, double, T >::type storage_type;
+	    typedef void tuple_type;
 
-      template <typename Idx, typename Tuple, typename Scalar>
-	 inline 
-	 typename boost::enable_if< 
-	 boost::mpl::greater< 
-	 Idx, 
-	 boost::mpl::size_t<0> 
-	    >,
-	 void >::type tuple_adds_impl( Tuple& result, const Tuple& lhs, const Scalar& rhs) {
-	    tuple_adds_impl<typename boost::mpl::prior<Idx>::type,Tuple,Scalar>(result,lhs,rhs);
-	    get<boost::mpl::prior<Idx>::type::value>(result) = get<boost::mpl::prior<Idx>::type::value>(lhs) + rhs;
+	    template <std::size_t K>
+	       struct eval {
+		  typedef tuple_expr_scalar_eval< storage_type > type;
+	       };
+
+	    template <std::size_t K>
+	       static inline typename eval<K>::type make( const storage_type& s ) {
+		  typename eval<K>::type e = { s };
+		  return e;
+	       };
+
+	    template <std::size_t K>
+	       static inline std::size_t size( const storage_type& ) { return 0; };
 	 };
 
-      template <typename Idx, typename Tuple, typename Scalar>
+      template <typename T>
+	 struct is_tuple_expr_operand : 
+	    boost::mpl::not_< boost::is_void< typename tuple_expr_operand_tag< T >::type > > { };
+
+      template <typename T>
+	 struct is_tuple_expr_argument : 
+	    boost::mpl::or_< is_arithmetic_tuple_expr< T >, is_instance_of_arithmetic_tuple< T > > { };
+
+      template <typename L, typename R>
+	 struct is_tuple_expr_operands : 
+	    boost::mpl::and_< is_tuple_expr_operand< L >, is_tuple_expr_operand< R >, 
+	    boost::mpl::or_< is_tuple_expr_argument< L >, is_tuple_expr_argument< R > > > { };
+
+
+      template <typename Idx, typename Tuple, typename Expr, typename Assign>
 	 inline 
 	 typename boost::enable_if< 
 	 boost::mpl::equal_to< 
 	 Idx, 
 	 boost::mpl::size_t<0> 
 	    >,
-	 void >::type tuple_sadd_impl( Tuple& result, const Scalar& lhs, const Tuple& rhs) { };
+	 void >::type tuple_expr_assign_impl( Tuple& lhs, const Expr& rhs) { };
 
-      template <typename Idx, typename Tuple, typename Scalar>
+      template <typename Idx, typename Tuple, typename Expr, typename Assign>
 	 inline 
 	 typename boost::enable_if< 
 	 boost::mpl::greater< 
 	 Idx, 
 	 boost::mpl::size_t<0> 
 	    >,
-	 void >::type tuple_sadd_impl( Tuple& result, const Scalar& lhs, const Tuple& rhs) {
-	    tuple_sadd_impl<typename boost::mpl::prior<Idx>::type,Tuple,Scalar>(result,lhs,rhs);
-	    get<boost::mpl::prior<Idx>::type::value>(result) = lhs + get<boost::mpl::prior<Idx>::type::value>(rhs);
+	 void >::type tuple_expr_assign_impl( Tuple& lhs, const Expr& rhs) {
+	    tuple_expr_assign_impl< typename boost::mpl::prior<Idx>::type,Tuple,Expr,Assign >(lhs,rhs);
+	    const auto src = tuple_expr_operand< Expr >::template make< boost::mpl::prior<Idx>::type::value >(rhs);
+	    auto* dst = get<boost::mpl::prior<Idx>::type::value>(lhs).data();
+	    const std::size_t n = get<boost::mpl::prior<Idx>::type::value>(lhs).num_elements();
+	    for( std::size_t i = 0; i < n; ++i )
+	       Assign::apply( dst[i], src[i] );
 	 };
 
 
-      template <typename Idx, typename Tuple>
+      template <typename Idx, typename Expr>
 	 inline 
 	 typename boost::enable_if< 
 	 boost::mpl::equal_to< 
 	 Idx, 
 	 boost::mpl::size_t<0> 
 	    >,
-	 void >::type tuple_abs_impl( Tuple& result, const Tuple& tpl ) { };
+	 double >::type tuple_expr_norm_impl( const Expr& expr ) { return 0.0; };
 
-      template <typename Idx, typename Tuple>
+      template <typename Idx, typename Expr>
 	 inline 
 	 typename boost::enable_if< 
 	 boost::mpl::greater< 
 	 Idx, 
 	 boost::mpl::size_t<0> 
 	    >,
-	 void >::type tuple_abs_impl( Tuple& result, const Tuple& tpl ) {
-	    tuple_abs_impl< typename boost::mpl::prior<Idx>::type,Tuple >(result,tpl);
-	    get<boost::mpl::prior<Idx>::type::value>(result) = abs(get<boost::mpl::prior<Idx>::type::value>(tpl));
+	 double >::type tuple_expr_norm_impl( const Expr& expr ) {
+	    double result = tuple_expr_norm_impl< typename boost::mpl::prior<Idx>::type,Expr >(expr);
+	    const auto src = tuple_expr_operand< Expr >::template make< boost::mpl::prior<Idx>::type::value >(expr);
+	    const std::size_t n = tuple_expr_operand< Expr >::template size< boost::mpl::prior<Idx>::type::value >(expr);
+	    for( std::size_t i = 0; i < n; ++i )
+	       result = std::max( result, static_cast<double>( abs( src[i] ) ) );
+	    return result;
 	 };
 
 
@@ -611,119 +642,182 @@ namespace ReaK {
 
    }; // detail
 
-   // tuple + tuple
-   template <typename Tuple>
-      typename boost::enable_if< is_instance_of_arithmetic_tuple<Tuple>,
-	       Tuple >::type operator +(const Tuple& lhs, const Tuple& rhs) {
-		  Tuple result;
-		  detail::tuple_add_impl<arithmetic_tuple_size<Tuple>,Tuple>(result, lhs, rhs);
-		  return result;
+   /**
+    * This class template is the expression node of a binary element-wise operation on arithmetic-tuples. 
+    * No computation is done upon construction, the expression is evaluated element by element 
+    * only when it is assigned to an arithmetic-tuple, such that a whole expression like 
+    * x + dt * a1 * k1 + dt * a2 * k2 is performed in a single pass over the storage of each 
+    * tuple element, without any intermediate tuples. 
+    * Arithmetic-tuple operands are held by reference, the expression should thus not outlive them.
+    * \tparam Op The element-wise operation.
+    * \tparam L The type of the left operand (arithmetic-tuple, expression or scalar).
+    * \tparam R The type of the right operand (arithmetic-tuple, expression or scalar).
+    */
+   template <typename Op, typename L, typename R>
+      class arithmetic_tuple_binary_expr : public arithmetic_tuple_expr< arithmetic_tuple_binary_expr< Op, L, R > > {
+	 private:
+	    typedef detail::tuple_expr_operand< L > lhs_operand_t; 
+	    typedef detail::tuple_expr_operand< R > rhs_operand_t; 
+
+	    typename lhs_operand_t::storage_type lhs;
+	    typename rhs_operand_t::storage_type rhs;
+
+	 public:
+	    typedef typename boost::mpl::if_< boost::is_void< typename lhs_operand_t::tuple_type >, 
+		    typename rhs_operand_t::tuple_type, 
+		    typename lhs_operand_t::tuple_type >::type tuple_type; 
+
+	    template <std::size_t K>
+	       struct eval_type {
+		  typedef detail::tuple_expr_binary_eval< Op, 
+			  typename lhs_operand_t::template eval<K>::type, 
+			  typename rhs_operand_t::template eval<K>::type > type;
 	       };
 
-   // tuple - tuple
-   template <typename Tuple>
-      typename boost::enable_if< is_instance_of_arithmetic_tuple<Tuple>,
-	       Tuple >::type operator -(const Tuple& lhs, const Tuple& rhs) {
-		  Tuple result;
-		  detail::tuple_sub_impl<arithmetic_tuple_size<Tuple>,Tuple>(result, lhs, rhs);
-		  return result;
+	    arithmetic_tuple_binary_expr( const L& l, const R& r ) : lhs( l ), rhs( r ) { };
+
+	    template <std::size_t K>
+	       typename eval_type<K>::type eval() const {
+		  typename eval_type<K>::type e = { lhs_operand_t::template make<K>( lhs ), rhs_operand_t::template make<K>( rhs ) };
+		  return e;
 	       };
 
-   // -tuple
-   template <typename Tuple>
-      typename boost::enable_if< is_instance_of_arithmetic_tuple<Tuple>,
-	       Tuple >::type operator -(const Tuple& lhs) {
-		  Tuple result;
-		  detail::tuple_neg_impl<arithmetic_tuple_size<Tuple>,Tuple>(result, lhs);
-		  return result;
+	    template <std::size_t K>
+	       std::size_t size() const {
+		  return std::max( lhs_operand_t::template size<K>( lhs ), rhs_operand_t::template size<K>( rhs ) );
 	       };
+      };
 
-   // tuple += tuple
-   template <typename Tuple>
-      typename boost::enable_if< is_instance_of_arithmetic_tuple<Tuple>,
-	       Tuple& >::type operator +=(Tuple& lhs, const Tuple& rhs) {
-		  detail::tuple_addassign_impl<arithmetic_tuple_size<Tuple>,Tuple>(lhs, rhs);
-		  return lhs;
+   /**
+    * This class template is the expression node of a unary element-wise operation on arithmetic-tuples, 
+    * see arithmetic_tuple_binary_expr.
+    * \tparam Op The element-wise operation.
+    * \tparam E The type of the operand (arithmetic-tuple or expression).
+    */
+   template <typename Op, typename E>
+      class arithmetic_tuple_unary_expr : public arithmetic_tuple_expr< arithmetic_tuple_unary_expr< Op, E > > {
+	 private:
+	    typedef detail::tuple_expr_operand< E > operand_t; 
+
+	    typename operand_t::storage_type arg;
+
+	 public:
+	    typedef typename operand_t::tuple_type tuple_type; 
+
+	    template <std::size_t K>
+	       struct eval_type {
+		  typedef detail::tuple_expr_unary_eval< Op, typename operand_t::template eval<K>::type > type;
 	       };
 
-   // tuple -= tuple
-   template <typename Tuple>
-      typename boost::enable_if< is_instance_of_arithmetic_tuple<Tuple>,
-	       Tuple& >::type operator -=(Tuple& lhs, const Tuple& rhs) {
-		  detail::tuple_subassign_impl<arithmetic_tuple_size<Tuple>,Tuple>(lhs, rhs);
-		  return lhs;
+	    explicit arithmetic_tuple_unary_expr( const E& e ) : arg( e ) { };
+
+	    template <std::size_t K>
+	       typename eval_type<K>::type eval() const {
+		  typename eval_type<K>::type e = { operand_t::template make<K>( arg ) };
+		  return e;
 	       };
 
-   // tuple * tuple
-   template <typename Tuple>
-      typename boost::enable_if< is_instance_of_arithmetic_tuple<Tuple>,
-	       Tuple >::type operator *(const Tuple& lhs, const Tuple& rhs) {
-		  Tuple result;
-		  detail::tuple_mul_impl<arithmetic_tuple_size<Tuple>,Tuple>(result, lhs, rhs);
-		  return result;
+	    template <std::size_t K>
+	       std::size_t size() const { return operand_t::template size<K>( arg ); };
+      };
+
+   /* Specialization, see general template docs. */
+   template <typename Op, typename L, typename R>
+      struct arithmetic_tuple_size< arithmetic_tuple_binary_expr< Op, L, R > > : 
+      arithmetic_tuple_size< typename arithmetic_tuple_binary_expr< Op, L, R >::tuple_type > 
+   {}; 
+
+   /* Specialization, see general template docs. */
+   template <typename Op, typename E>
+      struct arithmetic_tuple_size< arithmetic_tuple_unary_expr< Op, E > > : 
+      arithmetic_tuple_size< typename arithmetic_tuple_unary_expr< Op, E >::tuple_type > 
+   {}; 
+
+   template <typename... T>
+      template <typename Expr>
+      arithmetic_tuple< T... >::arithmetic_tuple( const arithmetic_tuple_expr< Expr >& expr ) : base_t() {
+	 detail::tuple_expr_assign_impl<arithmetic_tuple_size< arithmetic_tuple< T... > >,arithmetic_tuple< T... >,Expr,detail::tuple_expr_assign>(*this, expr.self());
+      };
+
+   template <typename... T>
+      template <typename Expr>
+      arithmetic_tuple< T... >& arithmetic_tuple< T... >::operator=( const arithmetic_tuple_expr< Expr >& expr ) {
+	 detail::tuple_expr_assign_impl<arithmetic_tuple_size< arithmetic_tuple< T... > >,arithmetic_tuple< T... >,Expr,detail::tuple_expr_assign>(*this, expr.self());
+	 return *this;
+      };
+
+   // tuple + tuple, tuple + scalar, scalar + tuple
+   template <typename L, typename R>
+      typename boost::enable_if< detail::is_tuple_expr_operands< L, R >,
+	       arithmetic_tuple_binary_expr< detail::tuple_expr_add, L, R > >::type operator +(const L& lhs, const R& rhs) {
+		  return arithmetic_tuple_binary_expr< detail::tuple_expr_add, L, R >(lhs, rhs);
 	       };
 
-   // tuple / tuple
-   template <typename Tuple>
-      typename boost::enable_if< is_instance_of_arithmetic_tuple<Tuple>,
-	       Tuple >::type operator /(const Tuple& lhs, const Tuple& rhs) {
-		  Tuple result;
-		  detail::tuple_div_impl<arithmetic_tuple_size<Tuple>,Tuple>(result, lhs, rhs);
-		  return result;
+   // tuple - tuple, tuple - scalar, scalar - tuple
+   template <typename L, typename R>
+      typename boost::enable_if< detail::is_tuple_expr_operands< L, R >,
+	       arithmetic_tuple_binary_expr< detail::tuple_expr_sub, L, R > >::type operator -(const L& lhs, const R& rhs) {
+		  return arithmetic_tuple_binary_expr< detail::tuple_expr_sub, L, R >(lhs, rhs);
 	       };
 
-   // tuple * scalar
-   template <typename Tuple, typename Scalar>
-      typename boost::enable_if< boost::mpl::and_< is_instance_of_arithmetic_tuple< Tuple >, is_scalar< Scalar > >,
-	       Tuple >::type operator *(const Tuple& lhs, const Scalar& rhs) {
-		  Tuple result;
-		  detail::tuple_muls_impl<arithmetic_tuple_size<Tuple>,Tuple,Scalar>(result, lhs, rhs);
-		  return result;
+   // tuple * tuple, tuple * scalar, scalar * tuple
+   template <typename L, typename R>
+      typename boost::enable_if< detail::is_tuple_expr_operands< L, R >,
+	       arithmetic_tuple_binary_expr< detail::tuple_expr_mul, L, R > >::type operator *(const L& lhs, const R& rhs) {
+		  return arithmetic_tuple_binary_expr< detail::tuple_expr_mul, L, R >(lhs, rhs);
 	       };
 
-   // scalar * tuple
-   template <typename Tuple, typename Scalar>
-      typename boost::enable_if< boost::mpl::and_< is_instance_of_arithmetic_tuple< Tuple >, is_scalar< Scalar > >,
-	       Tuple >::type operator *(const Scalar& lhs, const Tuple& rhs) {
-		  Tuple result;
-		  detail::tuple_smul_impl<arithmetic_tuple_size<Tuple>,Tuple,Scalar>(result, lhs, rhs);
-		  return result;
+   // tuple / tuple, tuple / scalar, scalar / tuple
+   template <typename L, typename R>
+      typename boost::enable_if< detail::is_tuple_expr_operands< L, R >,
+	       arithmetic_tuple_binary_expr< detail::tuple_expr_div, L, R > >::type operator /(const L& lhs, const R& rhs) {
+		  return arithmetic_tuple_binary_expr< detail::tuple_expr_div, L, R >(lhs, rhs);
 	       };
 
-   // tuple * scalar
-   template <typename Tuple, typename Scalar>
-      typename boost::enable_if< boost::mpl::and_< is_instance_of_arithmetic_tuple< Tuple >, is_scalar< Scalar > >,
-	       Tuple >::type operator /(const Tuple& lhs, const Scalar& rhs) {
-		  Tuple result;
-		  detail::tuple_divs_impl<arithmetic_tuple_size<Tuple>,Tuple,Scalar>(result, lhs, rhs);
-		  return result;
+   // -tuple
+   template <typename E>
+      typename boost::enable_if< detail::is_tuple_expr_argument< E >,
+	       arithmetic_tuple_unary_expr< detail::tuple_expr_neg, E > >::type operator -(const E& arg) {
+		  return arithmetic_tuple_unary_expr< detail::tuple_expr_neg, E >(arg);
 	       };
 
-   // tuple + scalar
-   template <typename Tuple, typename Scalar>
-      typename boost::enable_if< boost::mpl::and_< is_instance_of_arithmetic_tuple< Tuple >, is_scalar< Scalar > >,
-	       Tuple >::type operator +(const Tuple& lhs, const Scalar& rhs) {
-		  Tuple result;
-		  detail::tuple_adds_impl<arithmetic_tuple_size<Tuple>,Tuple,Scalar>(result, lhs, rhs);
-		  return result;
+   // abs( tuple )
+   template <typename E>
+      typename boost::enable_if< detail::is_tuple_expr_argument< E >,
+	       arithmetic_tuple_unary_expr< detail::tuple_expr_abs, E > >::type abs(const E& arg) {
+		  return arithmetic_tuple_unary_expr< detail::tuple_expr_abs, E >(arg);
 	       };
 
-   // scalar + tuple
-   template <typename Tuple, typename Scalar>
-      typename boost::enable_if< boost::mpl::and_< is_instance_of_arithmetic_tuple< Tuple >, is_scalar< Scalar > >,
-	       Tuple >::type operator +(const Scalar& lhs, const Tuple& rhs) {
-		  Tuple result;
-		  detail::tuple_sadd_impl<arithmetic_tuple_size<Tuple>,Tuple,Scalar>(result, lhs, rhs);
-		  return result;
+   // tuple += tuple
+   template <typename Tuple>
+      typename boost::enable_if< is_instance_of_arithmetic_tuple<Tuple>,
+	       Tuple& >::type operator +=(Tuple& lhs, const Tuple& rhs) {
+		  detail::tuple_addassign_impl<arithmetic_tuple_size<Tuple>,Tuple>(lhs, rhs);
+		  return lhs;
 	       };
 
-   // abs( tuple )
+   // tuple -= tuple
    template <typename Tuple>
       typename boost::enable_if< is_instance_of_arithmetic_tuple<Tuple>,
-	       Tuple >::type abs(const Tuple& tpl) {
-		  Tuple result;
-		  detail::tuple_abs_impl<arithmetic_tuple_size<Tuple>,Tuple>(result, tpl);
-		  return result;
+	       Tuple& >::type operator -=(Tuple& lhs, const Tuple& rhs) {
+		  detail::tuple_subassign_impl<arithmetic_tuple_size<Tuple>,Tuple>(lhs, rhs);
+		  return lhs;
+	       };
+
+   // tuple += expression
+   template <typename Tuple, typename Expr>
+      typename boost::enable_if< boost::mpl::and_< is_instance_of_arithmetic_tuple< Tuple >, is_arithmetic_tuple_expr< Expr > >,
+	       Tuple& >::type operator +=(Tuple& lhs, const Expr& rhs) {
+		  detail::tuple_expr_assign_impl<arithmetic_tuple_size<Tuple>,Tuple,Expr,detail::tuple_expr_addassign>(lhs, rhs);
+		  return lhs;
+	       };
+
+   // tuple -= expression
+   template <typename Tuple, typename Expr>
+      typename boost::enable_if< boost::mpl::and_< is_instance_of_arithmetic_tuple< Tuple >, is_arithmetic_tuple_expr< Expr > >,
+	       Tuple& >::type operator -=(Tuple& lhs, const Expr& rhs) {
+		  detail::tuple_expr_assign_impl<arithmetic_tuple_size<Tuple>,Tuple,Expr,detail::tuple_expr_subassign>(lhs, rhs);
+		  return lhs;
 	       };
 
    //norm( tuple )
@@ -733,6 +827,13 @@ namespace ReaK {
 		  return detail::tuple_norm_impl<arithmetic_tuple_size<Tuple>,Tuple>(tpl);
 	       };
 
+   //norm( expression ), evaluated without materializing the expression
+   template <typename Expr>
+      typename boost::enable_if< is_arithmetic_tuple_expr<Expr>,
+	       double >::type norm(const Expr& expr) {
+		  return detail::tuple_expr_norm_impl<arithmetic_tuple_size<Expr>,Expr>(expr);
+	       };
+
    // tuple *= tuple
    template <typename Tuple>
       typename boost::enable_if< is_instance_of_arithmetic_tuple<Tuple>,
@@ -0,0 +1,408 @@
+#pragma once
+
+#include <cmath>
+#include <complex>
+#include <limits>
+#include <cstddef>
+#include <algorithm>
+#include <type_traits>
+
+#include <boost/numeric/odeint/algebra/default_operations.hpp>
+
+#include <arithmetic_tuple.h>
+#include <gf_parallel.h>
+
+/********************* Odeint algebra and operations for arithmetic tuples of gf's  ********************/
+
+// Element in double precision, arithmetic on single-precision elements ( complex< float > ) is carried out in double
+template< typename value_t >
+inline std::complex< double > gf_elem_promote( const std::complex< value_t >& val ) { return std::complex< double >( val ); }
+inline double gf_elem_promote( const double val ) { return val; }
+
+// Unit roundoff of an element type
+template< typename value_t >
+struct gf_elem_eps { static constexpr double value = std::numeric_limits< value_t >::epsilon(); };
+template< typename value_t >
+struct gf_elem_eps< std::complex< value_t > > : gf_elem_eps< value_t > {};
+
+// Squared magnitude, used to compare magnitudes without taking the square root
+template< typename value_t >
+inline double gf_elem_abs2( const std::complex< value_t >& val ) { return std::norm( gf_elem_promote( val ) ); }
+inline double gf_elem_abs2( const double val ) { return val * val; }
+
+// Magnitude of a single gf element, sqrt( norm ) vectorizes in contrast to std::abs (hypot) for complex values
+template< typename value_t >
+inline double gf_elem_abs( const std::complex< value_t >& val ) { return std::sqrt( gf_elem_abs2( val ) ); }
+inline double gf_elem_abs( const double val ) { return std::abs( val ); }
+
+// Real inner product Re( conj( a ) b ) of two gf elements
+template< typename value_t >
+inline double gf_elem_dot( const std::complex< value_t >& a, const std::complex< value_t >& b ) { return double( a.real() ) * b.real() + double( a.imag() ) * b.imag(); }
+inline double gf_elem_dot( const double a, const double b ) { return a * b; }
+
+namespace gf_detail {
+
+   // Loop over n elements in rows of L elements. With the compile-time trip count the inner loop is fully
+   // unrolled and vectorized without remainder handling, a partial last row is handled separately
+   template< std::size_t L >
+   struct gf_row_loop
+   {
+      template< typename Op, typename... P >
+      static inline void apply( Op& op, const std::size_t n, P... p )
+      {
+	 const std::size_t rows = n / L;
+	 for( std::size_t r = 0; r < rows; ++r )
+	    for( std::size_t j = 0; j < L; ++j )
+	       op( p[ r * L + j ]... );
+	 for( std::size_t i = rows * L; i < n; ++i )
+	    op( p[i]... );
+      }
+
+      template< typename P >
+      static inline double max_abs2( const std::size_t n, P p )
+      {
+	 const std::size_t rows = n / L;
+	 double res = 0.0;
+	 for( std::size_t r = 0; r < rows; ++r )
+	    for( std::size_t j = 0; j < L; ++j )
+	       res = std::max( res, gf_elem_abs2( p[ r * L + j ] ) );
+	 for( std::size_t i = rows * L; i < n; ++i )
+	    res = std::max( res, gf_elem_abs2( p[i] ) );
+	 return res;
+      }
+   };
+
+   // Runtime length
+   template<>
+   struct gf_row_loop< 0 >
+   {
+      template< typename Op, typename... P >
+      static inline void apply( Op& op, const std::size_t n, P... p )
+      {
+	 for( std::size_t i = 0; i < n; ++i )
+	    op( p[i]... );
+      }
+
+      template< typename P >
+      static inline double max_abs2( const std::size_t n, P p )
+      {
+	 double res = 0.0;
+	 for( std::size_t i = 0; i < n; ++i )
+	    res = std::max( res, gf_elem_abs2( p[i] ) );
+	 return res;
+      }
+   };
+
+   // Elementwise op on single-precision elements: each element is converted to double precision in registers,
+   // op computes and accumulates in double and, like the odeint operations, only writes to its first operand,
+   // which is rounded back to single precision in the same pass. No element is staged in a buffer
+   template< typename Op >
+   struct gf_promoted_op
+   {
+      Op& op;
+
+      template< typename... T >
+      inline void operator()( std::complex< float >& t1, const T&... t ) const
+      {
+	 std::complex< double > d1( t1 );
+	 op( d1, gf_elem_promote( t )... );
+	 t1 = std::complex< float >( d1 );
+      }
+
+      template< typename... T >
+      inline void operator()( const std::complex< float >& t1, const T&... t ) const { op( gf_elem_promote( t1 ), gf_elem_promote( t )... ); }
+   };
+
+   template< typename Op, typename P1, typename... P >
+   inline void gf_promoted_for_each( Op& op, const std::size_t n, P1 p1, P... p )
+   {
+      const gf_promoted_op< Op > promoted{ op };
+      gf_row_loop< 0 >::apply( promoted, n, p1, p... );
+   }
+
+   // Length of the rows along the last ( fermionic ) frequency, 2N for the ffreq( N ) grids
+   template< typename gf_t >
+   inline std::size_t gf_row_len( const gf_t& gf_obj ) { return gf_obj.shape()[ gf_t::dimensionality - 1 ]; }
+
+   // Apply op to the elements at the same position of all gf storages, pointers are hoisted out of the loop.
+   // Dispatches to the loops specialized for N = 64, 128, 256, 512, generic loop otherwise
+   template< typename Op, typename P1, typename... P >
+   inline void gf_for_each_ptr( Op& op, const std::size_t n, const std::size_t row_len, P1 p1, P... p )
+   {
+      switch( row_len )
+      {
+	 case 2 * 64: 	gf_row_loop< 2 * 64 >::apply( op, n, p1, p... ); break;
+	 case 2 * 128: 	gf_row_loop< 2 * 128 >::apply( op, n, p1, p... ); break;
+	 case 2 * 256: 	gf_row_loop< 2 * 256 >::apply( op, n, p1, p... ); break;
+	 case 2 * 512: 	gf_row_loop< 2 * 512 >::apply( op, n, p1, p... ); break;
+	 default: 	gf_row_loop< 0 >::apply( op, n, p1, p... );
+      }
+   }
+
+   // Single-precision storages are promoted to double precision element by element in registers, see gf_promoted_op
+   template< typename Op, typename... P >
+   inline void gf_for_each_ptr( Op& op, const std::size_t n, const std::size_t, std::complex< float >* p1, P... p )
+   { gf_promoted_for_each( op, n, p1, p... ); }
+
+   template< typename Op, typename... P >
+   inline void gf_for_each_ptr( Op& op, const std::size_t n, const std::size_t, const std::complex< float >* p1, P... p )
+   { gf_promoted_for_each( op, n, p1, p... ); }
+
+   // Recursion over the members of the arithmetic tuples, each member is traversed once. Members paged in
+   // from files are traversed in windows of rows, see gf_for_windows
+   template< std::size_t K, std::size_t Size >
+   struct gf_for_each_impl
+   {
+      template< typename Op, typename S1, typename... S >
+      static inline void apply( Op& op, S1& s1, S&... s )
+      {
+	 auto& g1 = std::get< K >( s1 );
+	 const std::size_t n = g1.num_elements(), row_len = gf_row_len( g1 );
+	 const long n_rows = row_len > 0 ? ( n + row_len - 1 ) / row_len : 0;
+	 gf_for_windows( n_rows, row_len, [&]( const long r_begin, const long r_end )
+	       {
+		  const std::size_t first = r_begin * row_len, count = std::min( r_end * row_len, n ) - first;
+		  gf_for_each_ptr( op, count, row_len, g1.data() + first, std::get< K >( s ).data() + first... );
+	       }, g1, std::get< K >( s )... );
+	 gf_for_each_impl< K + 1, Size >::apply( op, s1, s... );
+      }
+   };
+
+   template< std::size_t Size >
+   struct gf_for_each_impl< Size, Size >
+   {
+      template< typename Op, typename... S >
+      static inline void apply( Op&, S&... ) {}
+   };
+
+   template< typename Op, typename S1, typename... S >
+   inline void gf_for_each( Op& op, S1& s1, S&... s )
+   {
+      gf_for_each_impl< 0, ReaK::arithmetic_tuple_size< typename std::remove_const< S1 >::type >::value >::apply( op, s1, s... );
+   }
+
+   template< typename P >
+   inline double gf_max_abs2_ptr( const std::size_t n, const std::size_t row_len, P p )
+   {
+      switch( row_len )
+      {
+	 case 2 * 64: 	return gf_row_loop< 2 * 64 >::max_abs2( n, p );
+	 case 2 * 128: 	return gf_row_loop< 2 * 128 >::max_abs2( n, p );
+	 case 2 * 256: 	return gf_row_loop< 2 * 256 >::max_abs2( n, p );
+	 case 2 * 512: 	return gf_row_loop< 2 * 512 >::max_abs2( n, p );
+	 default: 	return gf_row_loop< 0 >::max_abs2( n, p );
+      }
+   }
+
+   // Maximum squared magnitude over all members of the arithmetic tuple
+   template< std::size_t K, std::size_t Size >
+   struct gf_max_abs2_impl
+   {
+      template< typename S >
+      static inline double apply( const S& s )
+      {
+	 const auto& g = std::get< K >( s );
+	 const std::size_t n = g.num_elements(), row_len = gf_row_len( g );
+	 const long n_rows = row_len > 0 ? ( n + row_len - 1 ) / row_len : 0;
+	 double res = 0.0;
+	 gf_for_windows( n_rows, row_len, [&]( const long r_begin, const long r_end )
+	       {
+		  const std::size_t first = r_begin * row_len, count = std::min( r_end * row_len, n ) - first;
+		  res = std::max( res, gf_max_abs2_ptr( count, row_len, g.data() + first ) );
+	       }, g );
+	 return std::max( res, gf_max_abs2_impl< K + 1, Size >::apply( s ) );
+      }
+   };
+
+   template< std::size_t Size >
+   struct gf_max_abs2_impl< Size, Size >
+   {
+      template< typename S >
+      static inline double apply( const S& ) { return 0.0; }
+   };
+
+   // Sum of the real inner products of the elements
+   struct inner_prod_op
+   {
+      double res;
+
+      template< class T1, class T2 >
+      inline void operator()( const T1& a, const T2& b ) { res += gf_elem_dot( a, b ); }
+   };
+
+   // Maximum of the weighted error | err | / ( eps_abs + eps_rel * ( a_x * | x | + a_dxdt * | dxdt | ) ), accumulated elementwise
+   struct max_rel_error_op
+   {
+      double eps_abs, rel_x, rel_dxdt;
+      double res;
+
+      template< class T1, class T2, class T3 >
+      inline void operator()( const T1& err, const T2& x, const T3& dxdt )
+      {
+	 res = std::max( res, gf_elem_abs( err ) / ( eps_abs + rel_x * gf_elem_abs( x ) + rel_dxdt * gf_elem_abs( dxdt ) ) );
+      }
+   };
+
+   // Largest unit roundoff of the members of an arithmetic tuple
+   template< std::size_t K, std::size_t Size >
+   struct gf_state_eps_impl
+   {
+      template< typename S >
+      static constexpr double eps() { return gf_elem_eps< typename std::decay< decltype( std::get< K >( std::declval< const S& >() ) ) >::type::element >::value; }
+
+      template< typename S >
+      static constexpr double apply()
+      {
+	 return eps< S >() > gf_state_eps_impl< K + 1, Size >::template apply< S >() ? eps< S >() : gf_state_eps_impl< K + 1, Size >::template apply< S >();
+      }
+   };
+
+   template< std::size_t Size >
+   struct gf_state_eps_impl< Size, Size >
+   {
+      template< typename S >
+      static constexpr double apply() { return 0.0; }
+   };
+
+} // namespace gf_detail
+
+// Unit roundoff of the least precise member of a state, e.g. 6e-8 if a member stores complex< float >
+template< typename S >
+constexpr double gf_state_eps() { return gf_detail::gf_state_eps_impl< 0, ReaK::arithmetic_tuple_size< S >::value >::template apply< S >(); }
+
+// Relative tolerance attainable with the precision of the state. Errors of a few roundoffs of the stored
+// elements are noise which no step size can reduce, e.g. below 2e-6 for single-precision vertices ( GF_FLOAT )
+template< typename S >
+inline double gf_rel_tol_floor( const double eps_rel ) { return std::max( eps_rel, 16.0 * gf_state_eps< S >() ); }
+
+/**
+ * Odeint algebra for arithmetic tuples of gf's (e.g. state_t). Instead of combining whole states
+ * through the arithmetic operators, like the vector_space_algebra, the elementwise operation is
+ * applied in a single pass over the contiguous storage of every tuple member. All stage buffers
+ * are thus read exactly once per stage, and no temporary states are created. Members stored in
+ * single precision ( complex< float > ) are operated on in double precision, only the result is
+ * rounded, such that the stages, norms and errors accumulate in double.
+ */
+struct gf_algebra
+{
+   template< class S1, class Op >
+   static void for_each1( S1& s1, Op op )
+   { gf_detail::gf_for_each( op, s1 ); }
+
+   template< class S1, class S2, class Op >
+   static void for_each2( S1& s1, S2& s2, Op op )
+   { gf_detail::gf_for_each( op, s1, s2 ); }
+
+   template< class S1, class S2, class S3, class Op >
+   static void for_each3( S1& s1, S2& s2, S3& s3, Op op )
+   { gf_detail::gf_for_each( op, s1, s2, s3 ); }
+
+   template< class S1, class S2, class S3, class S4, class Op >
+   static void for_each4( S1& s1, S2& s2, S3& s3, S4& s4, Op op )
+   { gf_detail::gf_for_each( op, s1, s2, s3, s4 ); }
+
+   template< class S1, class S2, class S3, class S4, class S5, class Op >
+   static void for_each5( S1& s1, S2& s2, S3& s3, S4& s4, S5& s5, Op op )
+   { gf_detail::gf_for_each( op, s1, s2, s3, s4, s5 ); }
+
+   template< class S1, class S2, class S3, class S4, class S5, class S6, class Op >
+   static void for_each6( S1& s1, S2& s2, S3& s3, S4& s4, S5& s5, S6& s6, Op op )
+   { gf_detail::gf_for_each( op, s1, s2, s3, s4, s5, s6 ); }
+
+   template< class S1, class S2, class S3, class S4, class S5, class S6, class S7, class Op >
+   static void for_each7( S1& s1, S2& s2, S3& s3, S4& s4, S5& s5, S6& s6, S7& s7, Op op )
+   { gf_detail::gf_for_each( op, s1, s2, s3, s4, s5, s6, s7 ); }
+
+   template< class S1, class S2, class S3, class S4, class S5, class S6, class S7, class S8, class Op >
+   static void for_each8( S1& s1, S2& s2, S3& s3, S4& s4, S5& s5, S6& s6, S7& s7, S8& s8, Op op )
+   { gf_detail::gf_for_each( op, s1, s2, s3, s4, s5, s6, s7, s8 ); }
+
+   // Maximum norm, the square root is only taken once for the final result
+   template< class S >
+   static double norm_inf( const S& s )
+   { return std::sqrt( gf_detail::gf_max_abs2_impl< 0, ReaK::arithmetic_tuple_size< S >::value >::apply( s ) ); }
+
+   // Maximum of the weighted error in a single pass over err, x and dxdt, see gf_error_checker
+   template< class S1, class S2, class S3 >
+   static double max_rel_error( const S1& err, const S2& x, const S3& dxdt, const double eps_abs, const double eps_rel, const double a_x, const double a_dxdt )
+   {
+      gf_detail::max_rel_error_op op{ eps_abs, eps_rel * a_x, eps_rel * a_dxdt, 0.0 };
+      gf_detail::gf_for_each( op, err, x, dxdt );
+      return op.res;
+   }
+
+   // Real inner product sum Re( conj( s1 ) s2 ) over all elements, used by the Krylov solver of gf_implicit.h
+   template< class S1, class S2 >
+   static double inner_prod( const S1& s1, const S2& s2 )
+   {
+      gf_detail::inner_prod_op op{ 0.0 };
+      gf_detail::gf_for_each( op, s1, s2 );
+      return op.res;
+   }
+};
+
+/**
+ * Odeint operations for the gf_algebra. The scale_sum operations of the default_operations are
+ * already applied elementwise and in place by the algebra, only the relative error is replaced by
+ * a version which computes the magnitude of complex elements without std::abs (hypot).
+ */
+struct gf_operations : public boost::numeric::odeint::default_operations
+{
+   template< class Fac1 = double >
+   struct rel_error
+   {
+      const Fac1 m_eps_abs, m_eps_rel, m_a_x, m_a_dxdt;
+
+      rel_error( Fac1 eps_abs, Fac1 eps_rel, Fac1 a_x, Fac1 a_dxdt ):
+	 m_eps_abs( eps_abs ), m_eps_rel( eps_rel ), m_a_x( a_x ), m_a_dxdt( a_dxdt )
+      {}
+
+      // t3 = |t3| / ( eps_abs + eps_rel * ( a_x * |t1| + a_dxdt * |t2| ) )
+      template< class T1, class T2, class T3 >
+      void operator()( T3& t3, const T1& t1, const T2& t2 ) const
+      {
+	 t3 = gf_elem_abs( t3 ) / ( m_eps_abs + m_eps_rel * ( m_a_x * gf_elem_abs( t1 ) + m_a_dxdt * gf_elem_abs( t2 ) ) );
+      }
+
+      typedef void result_type;
+   };
+};
+
+/**
+ * Error checker for the controlled steppers, replacing the default_error_checker of odeint. Instead of
+ * overwriting the error estimate with the weighted errors and taking their maximum norm in a second
+ * pass, the maximum is accumulated while reading err, x and dxdt once, and nothing is written. The
+ * algebra has to provide max_rel_error ( gf_algebra, soa_algebra and their instr/mpi wrappers ).
+ */
+template< class Value, class Algebra, class Operations >
+class gf_error_checker
+{
+   public:
+      typedef Value value_type;
+      typedef Algebra algebra_type;
+      typedef Operations operations_type;
+
+      gf_error_checker( const value_type eps_abs = 1.0e-6, const value_type eps_rel = 1.0e-6, const value_type a_x = 1, const value_type a_dxdt = 1 ):
+	 m_eps_abs( eps_abs ), m_eps_rel( eps_rel ), m_a_x( a_x ), m_a_dxdt( a_dxdt )
+      {}
+
+      template< class State, class Deriv, class Err, class Time >
+      value_type error( const State& x_old, const Deriv& dxdt_old, Err& x_err, Time dt ) const
+      {
+	 algebra_type algebra;
+	 return error( algebra, x_old, dxdt_old, x_err, dt );
+      }
+
+      // x_err is left unchanged, the relative tolerance is limited by the precision of the state, see gf_rel_tol_floor
+      template< class State, class Deriv, class Err, class Time >
+      value_type error( algebra_type& algebra, const State& x_old, const Deriv& dxdt_old, Err& x_err, Time dt ) const
+      {
+	 return algebra.max_rel_error( x_err, x_old, dxdt_old, m_eps_abs, gf_rel_tol_floor< State >( m_eps_rel ), m_a_x, m_a_dxdt * std::abs( dt ) );
+      }
+
+   private:
+      value_type m_eps_abs;
+      value_type m_eps_rel;
+      value_type m_a_x;
+      value_type m_a_dxdt;
+};
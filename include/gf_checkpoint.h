@@ -0,0 +1,517 @@
+#pragma once
+
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <boost/numeric/odeint/stepper/controlled_step_result.hpp>
+#include <boost/numeric/odeint/stepper/controlled_runge_kutta.hpp>
+#include <boost/numeric/odeint/integrate/null_observer.hpp>
+
+#include <arithmetic_tuple.h>
+#include <gf_mpi.h>
+#include <gf_instr.h>
+
+/********************* Binary checkpoint and restart of states  ********************/
+
+/**
+ * File layout ( native byte order ), one file per MPI rank:
+ *   chk_header_t
+ *   per tuple member: chk_member_t, shape[ rank ], index_bases[ rank ], elements
+ * The elements of every member start at a multiple of the alignment in the header, the page size, such that
+ * members stored in files ( gf_mmap ) are cloned into the checkpoint where the filesystem supports it.
+ */
+namespace chk_detail {
+
+   constexpr char magic[8] = { 'G', 'F', 'C', 'H', 'K', '0', '0', '2' };
+   constexpr std::size_t alignment = 64; 	///< Default alignment of the elements, e.g. in trajectory snapshots
+
+   struct chk_header_t
+   {
+      char magic[8];
+      std::uint64_t num_members;
+      std::uint64_t steps; 		///< Number of accepted steps
+      double t; 			///< Current scale
+      double dt; 			///< Step size proposed by the controlled stepper
+      std::uint64_t alignment; 		///< Elements of the members start at multiples of it
+   };
+
+   struct chk_member_t
+   {
+      std::uint64_t rank;
+      std::uint64_t elem_size; 		///< Bytes per element
+      std::uint64_t num_elements;
+   };
+
+   inline std::size_t aligned( const std::size_t offset, const std::size_t align = alignment ) { return ( offset + align - 1 ) / align * align; }
+
+   // Destinations of the serialization: a buffer ( trajectory snapshots ) or a file, which is written directly
+   // such that a checkpoint needs no second copy of the state in memory
+   struct file_sink_t
+   {
+      std::FILE* file;
+      std::size_t offset; 		///< Bytes written so far
+      bool ok; 			///< Whether all writes succeeded
+      std::size_t align; 		///< Alignment of the elements
+   };
+
+   inline void sink_put( std::vector< char >& buf, const char* p, const std::size_t n ) { buf.insert( buf.end(), p, p + n ); }
+   inline void sink_put( file_sink_t& sink, const char* p, const std::size_t n )
+   {
+      sink.ok = sink.ok && std::fwrite( p, 1, n, sink.file ) == n;
+      sink.offset += n;
+   }
+
+   inline std::size_t sink_size( const std::vector< char >& buf ) { return buf.size(); }
+   inline std::size_t sink_size( const file_sink_t& sink ) { return sink.offset; }
+
+   inline std::size_t sink_alignment( const std::vector< char >& ) { return alignment; }
+   inline std::size_t sink_alignment( const file_sink_t& sink ) { return sink.align; }
+
+   // Zero padding up to the next aligned offset
+   template< typename Sink >
+   void sink_align( Sink& sink )
+   {
+      static const char zeros[ alignment ] = {};
+      std::size_t pad = aligned( sink_size( sink ), sink_alignment( sink ) ) - sink_size( sink );
+      for( ; pad > 0; pad -= std::min( pad, alignment ) )
+	 sink_put( sink, zeros, std::min( pad, alignment ) );
+   }
+
+   // Contiguous storage is written in one block, proxy storages ( e.g. gf_soa ) elementwise
+   template< typename Sink, typename gf_t >
+   auto write_elems( Sink& sink, const gf_t& gf_obj, int ) -> typename std::enable_if< std::is_pointer< decltype( gf_obj.data() ) >::value >::type
+   {
+      sink_put( sink, reinterpret_cast< const char* >( gf_obj.data() ), gf_obj.num_elements() * sizeof( typename gf_t::element ) );
+   }
+
+   template< typename Sink, typename gf_t >
+   void write_elems( Sink& sink, const gf_t& gf_obj, long )
+   {
+      for( std::size_t i = 0; i < gf_obj.num_elements(); ++i )
+      {
+	 const typename gf_t::element val = gf_obj( int( i ) );
+	 sink_put( sink, reinterpret_cast< const char* >( &val ), sizeof( val ) );
+      }
+   }
+
+   // Storages in files ( gf_mmap ) write their elements themselves, as a clone of their pages where supported
+   template< typename gf_t >
+   auto write_elems( file_sink_t& sink, const gf_t& gf_obj, int ) -> decltype( gf_obj.snapshot( 0, std::size_t( 0 ) ), void() )
+   {
+      const std::size_t bytes = gf_obj.num_elements() * sizeof( typename gf_t::element );
+      sink.ok = sink.ok && std::fflush( sink.file ) == 0;
+      try
+      {
+	 if( sink.ok )
+	    gf_obj.snapshot( fileno( sink.file ), sink.offset );
+      }
+      catch( const std::runtime_error& )
+      {
+	 sink.ok = false;
+      }
+      sink.offset += bytes;
+      sink.ok = sink.ok && fseeko( sink.file, sink.offset, SEEK_SET ) == 0;
+   }
+
+   template< typename gf_t >
+   auto read_elems( gf_t& gf_obj, const char* src, int ) -> typename std::enable_if< std::is_pointer< decltype( gf_obj.data() ) >::value >::type
+   {
+      std::memcpy( gf_obj.data(), src, gf_obj.num_elements() * sizeof( typename gf_t::element ) );
+   }
+
+   template< typename gf_t >
+   void read_elems( gf_t& gf_obj, const char* src, long )
+   {
+      auto p = gf_obj.data();
+      for( std::size_t i = 0; i < gf_obj.num_elements(); ++i )
+      {
+	 typename gf_t::element val;
+	 std::memcpy( &val, src + i * sizeof( val ), sizeof( val ) );
+	 p[i] = val;
+      }
+   }
+
+   template< typename Sink, typename T >
+   void append( Sink& sink, const T& val )
+   {
+      sink_put( sink, reinterpret_cast< const char* >( &val ), sizeof( T ) );
+   }
+
+   // Description of a member: chk_member_t, shape and index bases
+   template< typename Sink, typename gf_t >
+   void write_member_info( Sink& sink, const gf_t& gf_obj )
+   {
+      const std::size_t rank = gf_t::dimensionality;
+      append( sink, chk_member_t{ rank, sizeof( typename gf_t::element ), gf_obj.num_elements() } );
+      for( std::size_t d = 0; d < rank; ++d )
+	 append( sink, std::int64_t( gf_obj.shape()[d] ) );
+      for( std::size_t d = 0; d < rank; ++d )
+	 append( sink, std::int64_t( gf_obj.index_bases()[d] ) );
+   }
+
+   // Elements of a member, starting at an aligned offset
+   template< typename Sink, typename gf_t >
+   void write_member_data( Sink& sink, const gf_t& gf_obj )
+   {
+      sink_align( sink );
+      write_elems( sink, gf_obj, 0 );
+   }
+
+   // Reads a member at offset, the extents have to match the ones of gf_obj. Returns the offset of the next member
+   template< typename gf_t >
+   std::size_t read_member( gf_t& gf_obj, const char* base, std::size_t offset, const std::size_t size, const std::size_t align )
+   {
+      const std::size_t rank = gf_t::dimensionality;
+      chk_member_t member;
+      if( offset + sizeof( member ) + 2 * rank * sizeof( std::int64_t ) > size )
+	 throw std::runtime_error( "checkpoint: truncated file" );
+      std::memcpy( &member, base + offset, sizeof( member ) );
+      offset += sizeof( member );
+      if( member.rank != rank || member.elem_size != sizeof( typename gf_t::element ) || member.num_elements != gf_obj.num_elements() )
+	 throw std::runtime_error( "checkpoint: gf type or size does not match" );
+      for( std::size_t d = 0; d < 2 * rank; ++d )
+      {
+	 std::int64_t ext;
+	 std::memcpy( &ext, base + offset, sizeof( ext ) );
+	 offset += sizeof( ext );
+	 if( ext != std::int64_t( d < rank ? gf_obj.shape()[d] : gf_obj.index_bases()[d - rank] ) )
+	    throw std::runtime_error( "checkpoint: gf extents do not match" );
+      }
+      offset = aligned( offset, align );
+      const std::size_t bytes = member.num_elements * member.elem_size;
+      if( offset + bytes > size )
+	 throw std::runtime_error( "checkpoint: truncated file" );
+      read_elems( gf_obj, base + offset, 0 );
+      return offset + bytes;
+   }
+
+   // Recursion over the members of the arithmetic tuple
+   template< std::size_t K, std::size_t Size >
+   struct members_impl
+   {
+      template< typename Sink, typename State >
+      static void write( Sink& sink, const State& x )
+      {
+	 write_member_info( sink, std::get< K >( x ) );
+	 write_member_data( sink, std::get< K >( x ) );
+	 members_impl< K + 1, Size >::write( sink, x );
+      }
+
+      template< typename Sink, typename State >
+      static void write_info( Sink& sink, const State& x )
+      {
+	 write_member_info( sink, std::get< K >( x ) );
+	 members_impl< K + 1, Size >::write_info( sink, x );
+      }
+
+      template< typename Sink, typename State >
+      static void write_data( Sink& sink, const State& x )
+      {
+	 write_member_data( sink, std::get< K >( x ) );
+	 members_impl< K + 1, Size >::write_data( sink, x );
+      }
+
+      template< typename State >
+      static void read( State& x, const char* base, std::size_t offset, const std::size_t size, const std::size_t align )
+      {
+	 members_impl< K + 1, Size >::read( x, base, read_member( std::get< K >( x ), base, offset, size, align ), size, align );
+      }
+   };
+
+   template< std::size_t Size >
+   struct members_impl< Size, Size >
+   {
+      template< typename Sink, typename State >
+      static void write( Sink&, const State& ) {}
+      template< typename Sink, typename State >
+      static void write_info( Sink&, const State& ) {}
+      template< typename Sink, typename State >
+      static void write_data( Sink&, const State& ) {}
+      template< typename State >
+      static void read( State&, const char*, std::size_t, const std::size_t, const std::size_t ) {}
+   };
+
+   // Read-only memory map of a whole file, unmapped on destruction
+   class mapped_file_t
+   {
+      public:
+	 mapped_file_t( const std::string& fname ):
+	    data_( nullptr ), size_( 0 )
+      {
+	 const int fd = open( fname.c_str(), O_RDONLY );
+	 if( fd < 0 )
+	    throw std::runtime_error( "checkpoint: can not open " + fname );
+	 struct stat st;
+	 if( fstat( fd, &st ) != 0 || st.st_size == 0 )
+	 {
+	    close( fd );
+	    throw std::runtime_error( "checkpoint: can not read " + fname );
+	 }
+	 size_ = st.st_size;
+	 void* p = mmap( nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0 );
+	 close( fd );
+	 if( p == MAP_FAILED )
+	    throw std::runtime_error( "checkpoint: can not map " + fname );
+	 data_ = static_cast< const char* >( p );
+	 madvise( const_cast< char* >( data_ ), size_, MADV_SEQUENTIAL | MADV_WILLNEED );
+      }
+
+	 ~mapped_file_t() { munmap( const_cast< char* >( data_ ), size_ ); }
+
+	 mapped_file_t( const mapped_file_t& ) = delete;
+	 mapped_file_t& operator=( const mapped_file_t& ) = delete;
+
+	 const char* data() const { return data_; }
+	 std::size_t size() const { return size_; }
+
+      private:
+	 const char* data_;
+	 std::size_t size_;
+   };
+
+   // Whether t is at t_end up to the roundoff of the scales, the remaining distance is no step
+   inline bool reached( const double t, const double t_end )
+   {
+      return t_end - t <= 16.0 * std::numeric_limits< double >::epsilon() * std::max( std::abs( t ), std::abs( t_end ) );
+   }
+
+} // namespace chk_detail
+
+/**
+ * Checkpoints of an arithmetic tuple of gf's ( e.g. state_t ) together with the scale t, the step size dt
+ * and the number of accepted steps. Files are first written under a temporary name, synced to disk and then
+ * renamed, such that an interrupted write never destroys the previous checkpoint. With MPI every rank writes its own slab
+ * to fname.<rank>. Restarts read the file through a memory map, the extents of all members are checked.
+ * Without a file name no checkpoints are written.
+ */
+class checkpoint_t
+{
+   public:
+      checkpoint_t( const std::string& fname, const int interval ):
+	 fname_( mpi_size() > 1 && !fname.empty() ? fname + "." + std::to_string( mpi_rank() ) : fname ), interval_( interval )
+   {}
+
+      bool enabled() const { return !fname_.empty(); }
+
+      // Whether a checkpoint is due after the given number of accepted steps
+      bool due( const std::size_t steps ) const { return enabled() && interval_ > 0 && steps % interval_ == 0; }
+
+      bool exists() const { return access( fname_.c_str(), R_OK ) == 0; }
+
+      const std::string& fname() const { return fname_; }
+
+      // Writes nothing if checkpoints are disabled
+      template< typename State >
+      void write( const State& x, const double t, const double dt, const std::size_t steps ) const
+      {
+	 using namespace chk_detail;
+	 if( !enabled() )
+	    return;
+	 chk_header_t header;
+	 std::memcpy( header.magic, magic, sizeof( magic ) );
+	 header.num_members = ReaK::arithmetic_tuple_size< State >::value;
+	 header.steps = steps;
+	 header.t = t;
+	 header.dt = dt;
+	 header.alignment = sysconf( _SC_PAGESIZE );
+
+	 // The members are written from their storage, the file is on disk before it replaces the previous checkpoint
+	 const std::string tmp = fname_ + ".tmp";
+	 file_sink_t sink{ std::fopen( tmp.c_str(), "wb" ), 0, true, header.alignment };
+	 if( sink.file == nullptr )
+	    throw std::runtime_error( "checkpoint: can not open " + tmp );
+	 append( sink, header );
+	 members_impl< 0, ReaK::arithmetic_tuple_size< State >::value >::write( sink, x );
+	 const bool synced = sink.ok && std::fflush( sink.file ) == 0 && fsync( fileno( sink.file ) ) == 0;
+	 if( std::fclose( sink.file ) != 0 || !synced || std::rename( tmp.c_str(), fname_.c_str() ) != 0 )
+	    throw std::runtime_error( "checkpoint: can not write " + fname_ );
+      }
+
+      // Restores x, t, dt and steps from the checkpoint, x has to be constructed with the same extents
+      template< typename State >
+      void read( State& x, double& t, double& dt, std::size_t& steps ) const
+      {
+	 using namespace chk_detail;
+	 const mapped_file_t file( fname_ );
+	 chk_header_t header;
+	 if( file.size() < sizeof( header ) )
+	    throw std::runtime_error( "checkpoint: truncated file" );
+	 std::memcpy( &header, file.data(), sizeof( header ) );
+	 if( std::memcmp( header.magic, magic, sizeof( magic ) ) != 0 || header.num_members != ReaK::arithmetic_tuple_size< State >::value )
+	    throw std::runtime_error( "checkpoint: " + fname_ + " is not a checkpoint of this version and state type" );
+	 if( header.alignment == 0 || ( header.alignment & ( header.alignment - 1 ) ) != 0 || header.alignment > ( std::uint64_t( 1 ) << 20 ) )
+	    throw std::runtime_error( "checkpoint: " + fname_ + " has a corrupt header" );
+	 members_impl< 0, ReaK::arithmetic_tuple_size< State >::value >::read( x, file.data(), sizeof( header ), file.size(), header.alignment );
+	 t = header.t;
+	 dt = header.dt;
+	 steps = header.steps;
+      }
+
+   private:
+      std::string fname_;
+      int interval_;
+};
+
+/**
+ * Step adjuster of the controlled steppers, replacing the default_step_adjuster of odeint, whose maximal
+ * step size ( 0: unlimited ) can be changed between the steps. Copies share the limit, such that a stepper
+ * constructed with a copy follows set_max_dt. Trial steps above the limit fail before any rhs evaluation.
+ */
+template< typename Value, typename Time >
+class gf_step_limiter
+{
+   public:
+      typedef Time time_type;
+      typedef Value value_type;
+
+      gf_step_limiter( const time_type max_dt = time_type( 0 ) ):
+	 max_dt_( std::make_shared< time_type >( max_dt ) )
+   {}
+
+      void set_max_dt( const time_type max_dt ) { *max_dt_ = max_dt; }
+      time_type get_max_dt() const { return *max_dt_; }
+
+      time_type decrease_step( const time_type dt, const value_type error, const int error_order ) const { return adjuster().decrease_step( dt, error, error_order ); }
+      time_type increase_step( const time_type dt, const value_type error, const int stepper_order ) const { return adjuster().increase_step( dt, error, stepper_order ); }
+      bool check_step_size_limit( const time_type dt ) const { return adjuster().check_step_size_limit( dt ); }
+
+   private:
+      boost::numeric::odeint::default_step_adjuster< value_type, time_type > adjuster() const { return boost::numeric::odeint::default_step_adjuster< value_type, time_type >( *max_dt_ ); }
+
+      std::shared_ptr< time_type > max_dt_;
+};
+
+/**
+ * One accepted step of a controlled stepper from t, retrying with the step sizes proposed after failed
+ * tries. Trial steps and rejections are instrumented.
+ */
+template< typename Stepper, typename System, typename State >
+void controlled_step( Stepper& stepper, System& system, State& x, double& t, double& dt )
+{
+   using boost::numeric::odeint::fail;
+   const std::size_t max_fails = 500;
+
+   std::size_t fails = 0;
+   for( ;; )
+   {
+      instr_scope_t scope( instr_region::STEP );
+      if( stepper.try_step( system, x, t, dt ) != fail )
+	 break;
+      instr_add( instr_count::STEPS_REJECTED );
+      if( ++fails == max_fails )
+	 throw std::runtime_error( "controlled_step: step size adjustment failed" );
+   }
+   instr_add( instr_count::STEPS_ACCEPTED );
+}
+
+/**
+ * Adaptive integration from t to t_end like odeint's integrate_adaptive, writing a checkpoint every
+ * chk.due( steps ) accepted steps and at the end. Continues from a checkpoint if t, dt and steps
+ * were restored with checkpoint_t::read. The observer is called at the start and after every accepted
+ * step. Steps, observer and checkpoints are instrumented and the periodic report of gf_instr.h is
+ * triggered after every step. Returns the total number of accepted steps.
+ */
+template< typename Stepper, typename System, typename State, typename Observer = boost::numeric::odeint::null_observer >
+std::size_t integrate_checkpointed( Stepper stepper, System system, State& x, double t, const double t_end, double dt, const checkpoint_t& chk,
+      std::size_t steps = 0, Observer observer = Observer() )
+{
+   {
+      instr_scope_t scope( instr_region::OBSERVER );
+      observer( x, t );
+   }
+   while( !chk_detail::reached( t, t_end ) )
+   {
+      if( t + dt > t_end )
+	 dt = t_end - t;
+      controlled_step( stepper, system, x, t, dt );
+
+      ++steps;
+      {
+	 instr_scope_t scope( instr_region::OBSERVER );
+	 observer( x, t );
+      }
+      if( chk.due( steps ) )
+      {
+	 instr_scope_t scope( instr_region::CHECKPOINT );
+	 chk.write( x, t, dt, steps );
+      }
+      instr_t::instance().report();
+   }
+   {
+      instr_scope_t scope( instr_region::CHECKPOINT );
+      chk.write( x, t, dt, steps );
+   }
+   return steps;
+}
+
+/**
+ * Integration with a dense-output stepper ( e.g. dense_output_runge_kutta of runge_kutta_dopri5 ) from
+ * t to t_end, observing the state at the scales [ times_begin, times_end ) by interpolation, like odeint's
+ * integrate_times. The stepper keeps its natural step sizes, only the last step is shortened to end
+ * at t_end by the maximal step size of limiter, which the controlled stepper of the dense-output stepper
+ * has to be constructed with. The stepper is not re-initialized, such that the derivative at the end of
+ * a step is reused by the next one ( FSAL ). Output scales beyond t_end are ignored, x is used as buffer for the interpolated states and
+ * holds the state at t_end on return. Checkpoints as for integrate_checkpointed. After a restart, the
+ * scales up to the restored t were already observed and are skipped. Failed trial steps are handled
+ * by the stepper and therefore not counted by the instrumentation. Returns the number of accepted steps.
+ */
+template< typename DenseStepper, typename System, typename State, typename Iterator, typename Observer >
+std::size_t integrate_times_checkpointed( DenseStepper stepper, gf_step_limiter< double, double > limiter, System system, State& x, double t, const double t_end, double dt, Iterator times_begin, Iterator times_end,
+      const checkpoint_t& chk, std::size_t steps, Observer observer )
+{
+   Iterator it = times_begin;
+   for( ; it != times_end && *it <= t; ++it )
+      if( steps == 0 && *it == t )
+      {
+	 instr_scope_t scope( instr_region::OBSERVER );
+	 observer( x, *it );
+      }
+
+   stepper.initialize( x, t, dt );
+   while( !chk_detail::reached( stepper.current_time(), t_end ) )
+   {
+      limiter.set_max_dt( t_end - stepper.current_time() );
+      {
+	 instr_scope_t scope( instr_region::STEP );
+	 stepper.do_step( system );
+      }
+      instr_add( instr_count::STEPS_ACCEPTED );
+      ++steps;
+
+      const double t_obs = chk_detail::reached( stepper.current_time(), t_end ) ? t_end : stepper.current_time();
+      for( ; it != times_end && *it <= t_obs; ++it )
+      {
+	 instr_scope_t scope( instr_region::OBSERVER );
+	 stepper.calc_state( *it, x );
+	 observer( x, *it );
+      }
+      if( chk.due( steps ) )
+      {
+	 instr_scope_t scope( instr_region::CHECKPOINT );
+	 chk.write( stepper.current_state(), stepper.current_time(), stepper.current_time_step(), steps );
+      }
+      instr_t::instance().report();
+   }
+
+   x = stepper.current_state();
+   {
+      instr_scope_t scope( instr_region::CHECKPOINT );
+      chk.write( x, stepper.current_time(), stepper.current_time_step(), steps );
+   }
+   return steps;
+}
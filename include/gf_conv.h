@@ -0,0 +1,200 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <complex>
+#include <cstddef>
+#include <algorithm>
+#include <stdexcept>
+
+/********************* FFT-based frequency sums over Matsubara frequencies  ********************/
+
+namespace conv_detail {
+
+   using dcomplex = std::complex< double >;
+
+   // In-place radix-2 FFT of fixed size, twiddles and bit reversal are tabulated once
+   class fft_t
+   {
+      public:
+	 fft_t( const std::size_t n ):
+	    n_( n ), rev_( n ), tw_( n / 2 )
+	 {
+	    if( n == 0 || ( n & ( n - 1 ) ) != 0 )
+	       throw std::invalid_argument( "fft_t: size has to be a power of two" );
+	    std::size_t bits = 0;
+	    while( ( std::size_t( 1 ) << bits ) < n )
+	       ++bits;
+	    for( std::size_t i = 0; i < n; ++i )
+	    {
+	       std::size_t r = 0;
+	       for( std::size_t b = 0; b < bits; ++b )
+		  r |= ( ( i >> b ) & 1 ) << ( bits - 1 - b );
+	       rev_[i] = r;
+	    }
+	    const double pi = std::acos( -1.0 );
+	    for( std::size_t k = 0; k < n / 2; ++k )
+	       tw_[k] = std::polar( 1.0, -2.0 * pi * k / n );
+	 }
+
+	 std::size_t size() const { return n_; }
+
+	 // x_k -> sum_j x_j exp( -+ 2 pi i j k / n ), the inverse is not normalized
+	 void forward( dcomplex* x ) const { transform( x, false ); }
+	 void inverse( dcomplex* x ) const { transform( x, true ); }
+
+      private:
+	 void transform( dcomplex* x, const bool inv ) const
+	 {
+	    for( std::size_t i = 0; i < n_; ++i )
+	       if( i < rev_[i] )
+		  std::swap( x[i], x[ rev_[i] ] );
+	    for( std::size_t len = 2; len <= n_; len <<= 1 )
+	    {
+	       const std::size_t half = len / 2, step = n_ / len;
+	       for( std::size_t i = 0; i < n_; i += len )
+		  for( std::size_t j = 0; j < half; ++j )
+		  {
+		     const dcomplex w = inv ? std::conj( tw_[ j * step ] ) : tw_[ j * step ];
+		     const dcomplex u = x[ i + j ], v = x[ i + j + half ] * w;
+		     x[ i + j ] = u + v;
+		     x[ i + j + half ] = u - v;
+		  }
+	    }
+	 }
+
+	 std::size_t n_;
+	 std::vector< std::size_t > rev_;
+	 std::vector< dcomplex > tw_;
+   };
+
+   // sum_{ m >= x - 1/2 } 1 / ( m + 1/2 )^2 = trigamma( x ), asymptotic series after shifting x beyond 10
+   inline double trigamma( double x )
+   {
+      double res = 0.0;
+      for( ; x < 10.0; x += 1.0 )
+	 res += 1.0 / ( x * x );
+      const double y = 1.0 / ( x * x );
+      return res + 1.0 / x + 0.5 * y + y / x * ( 1.0 / 6.0 - y * ( 1.0 / 30.0 - y / 42.0 ) );
+   }
+
+} // namespace conv_detail
+
+/**
+ * Bubble-type frequency sums of two fermionic functions f, g on the window n = -n_f .. n_f - 1
+ * ( ffreq( n_f ) ), for the bosonic transfer frequencies W = -n_b .. n_b ( bfreq( n_b ) ):
+ *
+ *   correlate: out( W ) = sum_n f( n ) g( n + W ) 		( particle-hole )
+ *   convolve:  out( W ) = sum_n f( n ) g( W - n - 1 ) 	( particle-particle )
+ *
+ * The direct sums cost O( n_f ) per W, the FFTs O( n log n ) for all W. The operands are zero-padded
+ * to a power of two large enough to exclude the wrap-around of the cyclic convolution.
+ *
+ * With tails, the sums run over all frequencies instead of the window: beyond the window f and g are
+ * continued by their asymptotic form c / nu_n ( nu_n = n + 1/2 ), where c is taken from the outermost
+ * element on either side. Up to n_b frequencies beyond the window enter the FFT explicitly, the remaining
+ * terms are summed in closed form ( telescoping for W != 0, trigamma for W = 0 ) with weights tabulated
+ * at construction. Without tails the sums are truncated to the window.
+ *
+ * The buffers are allocated once, a plan is used by one thread at a time.
+ */
+class freq_conv_t
+{
+   public:
+      using dcomplex = std::complex< double >;
+
+      freq_conv_t( const int n_f, const int n_b, const bool tails = true ):
+	 n_f_( n_f ), n_b_( n_b ), tails_( tails ), n_ext_( tails ? n_f + n_b : n_f ), fft_( fft_size( n_f, n_b, tails ) ),
+	 a_( fft_.size() ), b_( fft_.size() ), rev_( 2 * n_f ), w_plus_( 2 * n_b + 1 ), w_minus_( 2 * n_b + 1 )
+      {
+	 if( n_f <= 0 || n_b < 0 )
+	    throw std::invalid_argument( "freq_conv_t: requires n_f > 0 and n_b >= 0" );
+	 if( !tails )
+	    return;
+
+	 // Terms beyond the extended window, sum_{ m >= a } 1 / ( ( m + 1/2 ) ( m + 1/2 + V ) ) with the prefix sums h
+	 std::vector< double > h( n_ext_ + 1, 0.0 );
+	 for( int m = 0; m < n_ext_; ++m )
+	    h[ m + 1 ] = h[m] + 1.0 / ( m + 0.5 );
+	 auto remainder = [&]( const int a, const int V ){ return V == 0 ? conv_detail::trigamma( a + 0.5 ) : ( h[ a + V ] - h[a] ) / V; };
+	 for( int W = -n_b; W <= n_b; ++W )
+	 {
+	    w_plus_[ W + n_b ] = remainder( n_ext_ - std::max( W, 0 ), W );
+	    w_minus_[ W + n_b ] = remainder( n_ext_ - std::max( -W, 0 ), -W );
+	 }
+      }
+
+      int n_f() const { return n_f_; }
+      int n_b() const { return n_b_; }
+
+      // out( W ) = sum_n f( n ) g( n + W ), f and g hold 2 n_f elements, out 2 n_b + 1
+      void correlate( const dcomplex* f, const dcomplex* g, dcomplex* out )
+      {
+	 const std::size_t P = fft_.size();
+	 std::fill( a_.begin(), a_.end(), dcomplex( 0.0 ) );
+	 std::fill( b_.begin(), b_.end(), dcomplex( 0.0 ) );
+
+	 // f reversed ( index -i mod P ) and g, on the extended window n = -n_ext .. n_ext - 1 at i = n + n_ext
+	 const dcomplex fp = tail_plus( f ), fm = tail_minus( f ), gp = tail_plus( g ), gm = tail_minus( g );
+	 for( int n = -n_ext_; n < n_ext_; ++n )
+	 {
+	    const std::size_t i = n + n_ext_;
+	    a_[ ( P - i ) % P ] = value( f, fp, fm, n );
+	    b_[i] = value( g, gp, gm, n );
+	 }
+
+	 fft_.forward( a_.data() );
+	 fft_.forward( b_.data() );
+	 for( std::size_t k = 0; k < P; ++k )
+	    a_[k] *= b_[k];
+	 fft_.inverse( a_.data() );
+
+	 const double norm = 1.0 / P;
+	 for( int W = -n_b_; W <= n_b_; ++W )
+	 {
+	    dcomplex res = a_[ ( W + P ) % P ] * norm;
+	    if( tails_ )
+	       res += fp * gp * w_plus_[ W + n_b_ ] + fm * gm * w_minus_[ W + n_b_ ];
+	    out[ W + n_b_ ] = res;
+	 }
+      }
+
+      // out( W ) = sum_n f( n ) g( W - n - 1 ), the correlation with g( -n - 1 ) at -W
+      void convolve( const dcomplex* f, const dcomplex* g, dcomplex* out )
+      {
+	 std::reverse_copy( g, g + 2 * n_f_, rev_.begin() );
+	 correlate( f, rev_.data(), out );
+	 std::reverse( out, out + 2 * n_b_ + 1 );
+      }
+
+   private:
+      // Lags up to n_b on the extended window of 2 n_ext elements without wrap-around
+      static std::size_t fft_size( const int n_f, const int n_b, const bool tails )
+      {
+	 const std::size_t min_size = 2 * ( tails ? n_f + n_b : n_f ) + n_b + 1;
+	 std::size_t P = 1;
+	 while( P < min_size )
+	    P <<= 1;
+	 return P;
+      }
+
+      // Coefficients c of the tails c / nu_n above and below the window
+      dcomplex tail_plus( const dcomplex* f ) const { return tails_ ? f[ 2 * n_f_ - 1 ] * ( n_f_ - 0.5 ) : dcomplex( 0.0 ); }
+      dcomplex tail_minus( const dcomplex* f ) const { return tails_ ? f[0] * ( -n_f_ + 0.5 ) : dcomplex( 0.0 ); }
+
+      dcomplex value( const dcomplex* f, const dcomplex c_plus, const dcomplex c_minus, const int n ) const
+      {
+	 if( n >= n_f_ )
+	    return c_plus / ( n + 0.5 );
+	 if( n < -n_f_ )
+	    return c_minus / ( n + 0.5 );
+	 return f[ n + n_f_ ];
+      }
+
+      int n_f_, n_b_;
+      bool tails_;
+      int n_ext_; 					///< Window extended by the explicit tails
+      conv_detail::fft_t fft_;
+      std::vector< dcomplex > a_, b_, rev_; 		///< Padded operands and the reversed g of convolve
+      std::vector< double > w_plus_, w_minus_; 	///< Closed-form remainders of the tails above and below, by W + n_b
+};
@@ -0,0 +1,341 @@
+#pragma once
+
+#include <cmath>
+#include <array>
+#include <vector>
+#include <memory>
+#include <complex>
+#include <cstddef>
+#include <stdexcept>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+
+#include <boost/multi_array.hpp>
+
+#include <gf.h>
+#include <gf_algebra.h>
+#include <gf_pool.h>
+
+/********************* Compressed Matsubara grids with asymptotic tails  ********************/
+
+/**
+ * Matsubara indices stored along one frequency axis: the dense window of ffreq( n_dense ) ( fermionic )
+ * or bfreq( n_dense ) ( bosonic ), and beyond it n_sparse logarithmically spaced indices up to the
+ * effective cutoff, mirrored to negative frequencies ( n -> -n-1 fermionic, n -> -n bosonic ). With
+ * n_eff = n_dense the grid coincides with ffreq / bfreq. Positions are ordered by increasing index.
+ *
+ * Values at indices that are not stored are interpolated linearly in 1 / nu ( nu = n + 1/2 fermionic,
+ * nu = n bosonic ) between the neighbouring stored indices. Beyond the outermost stored index on either
+ * side they are extrapolated with the asymptotic form a + b / nu through the two outermost points. Both
+ * reproduce the high-frequency behaviour c0 + c1 / ( i nu ) of the gf's exactly.
+ */
+class freq_grid_t
+{
+   public:
+      freq_grid_t( const bool fermionic, const int n_dense, const int n_eff, const int n_sparse ):
+	 fermionic_( fermionic ), n_dense_( n_dense )
+   {
+      if( n_dense <= 0 || n_eff < n_dense || n_sparse < 0 )
+	 throw std::invalid_argument( "freq_grid_t: requires 0 < n_dense <= n_eff and n_sparse >= 0" );
+
+      // Non-negative indices: dense window, then the rounded logarithmic points above it
+      std::vector< int > pos_idx;
+      const int n_dense_max = fermionic ? n_dense - 1 : n_dense; 	// Largest index of the dense window
+      const int n_max = fermionic ? n_eff - 1 : n_eff;
+      for( int n = 0; n <= n_dense_max; ++n )
+	 pos_idx.push_back( n );
+      const double n_0 = std::max( n_dense_max, 1 );
+      for( int k = 1; k <= n_sparse && n_max > n_dense_max; ++k )
+      {
+	 const int n = std::lround( n_0 * std::pow( n_max / n_0, double( k ) / n_sparse ) );
+	 if( n > pos_idx.back() )
+	    pos_idx.push_back( n );
+      }
+
+      for( auto it = pos_idx.rbegin(); it != pos_idx.rend(); ++it )
+	 if( fermionic || *it > 0 )
+	    idx_.push_back( fermionic ? -*it - 1 : -*it );
+      idx_.insert( idx_.end(), pos_idx.begin(), pos_idx.end() );
+      n_sparse_ = pos_idx.size() - n_dense_max - 1;
+   }
+
+      int size() const { return idx_.size(); } 				///< Number of stored indices
+      int index( const int pos ) const { return idx_[pos]; } 		///< Matsubara index at a position
+      int index_min() const { return idx_.front(); }
+      int index_max() const { return idx_.back(); }
+      bool fermionic() const { return fermionic_; }
+      double nu( const int n ) const { return fermionic_ ? n + 0.5 : n; } 	///< Matsubara frequency in units of 2 pi / beta
+
+      // Position of a stored index, -1 otherwise
+      int pos( const int n ) const
+      {
+	 const int lo = -n_dense_;
+	 const int hi = fermionic_ ? n_dense_ : n_dense_ + 1;
+	 if( n >= lo && n < hi )
+	    return n_sparse_ + n - lo;
+	 const auto it = std::lower_bound( idx_.begin(), idx_.end(), n );
+	 return it != idx_.end() && *it == n ? int( it - idx_.begin() ) : -1;
+      }
+
+      /**
+       * Interpolation weights for an arbitrary index: value( n ) = ( 1 - w ) value( lo ) + w value( lo + 1 ).
+       * Stored indices give w = 0, extrapolation beyond the grid gives w outside of [ 0, 1 ].
+       */
+      void bracket( const int n, int& lo, double& w ) const
+      {
+	 lo = pos( n );
+	 w = 0.0;
+	 if( lo >= 0 )
+	 {
+	    if( lo == size() - 1 && lo > 0 )
+	    {
+	       --lo;
+	       w = 1.0;
+	    }
+	    return;
+	 }
+	 if( n < idx_.front() )
+	    lo = 0;
+	 else if( n > idx_.back() )
+	    lo = size() - 2;
+	 else
+	    lo = int( std::lower_bound( idx_.begin(), idx_.end(), n ) - idx_.begin() ) - 1;
+	 const double x = 1.0 / nu( n ), x_lo = 1.0 / nu( idx_[lo] ), x_hi = 1.0 / nu( idx_[lo + 1] );
+	 w = ( x - x_lo ) / ( x_hi - x_lo );
+      }
+
+   private:
+      bool fermionic_;
+      int n_dense_;
+      int n_sparse_; 			///< Number of sparse indices per sign
+      std::vector< int > idx_;
+};
+
+namespace grid_detail {
+
+   // Multilinear interpolation on the product of grids at the Matsubara indices idx, at( pos ) reads the element at a flat position
+   template< std::size_t R, typename idx_t, typename At >
+   inline auto interp( const std::array< const freq_grid_t*, R >& grids, const idx_t& idx, const At& at ) -> typename std::decay< decltype( at( 0 ) ) >::type
+   {
+      std::array< int, R > lo;
+      std::array< double, R > w;
+      for( unsigned d = 0; d < R; ++d )
+	 grids[d]->bracket( idx[d], lo[d], w[d] );
+
+      // Accumulated in double, also for single-precision elements
+      decltype( gf_elem_promote( at( 0 ) ) ) res( 0.0 );
+      for( unsigned corner = 0; corner < ( 1u << R ); ++corner )
+      {
+	 double weight = 1.0;
+	 int pos = 0;
+	 for( unsigned d = 0; d < R && weight != 0.0; ++d )
+	 {
+	    const bool up = corner & ( 1u << d );
+	    weight *= up ? w[d] : 1.0 - w[d];
+	    pos = pos * grids[d]->size() + lo[d] + up;
+	 }
+	 if( weight != 0.0 )
+	    res += weight * gf_elem_promote( at( pos ) );
+      }
+      return typename std::decay< decltype( at( 0 ) ) >::type( res );
+   }
+
+} // namespace grid_detail
+
+// Compressed grids for the fermionic and the bosonic frequencies
+inline std::shared_ptr< const freq_grid_t > fgrid( const int n_dense, const int n_eff, const int n_sparse ) { return std::make_shared< const freq_grid_t >( true, n_dense, n_eff, n_sparse ); }
+inline std::shared_ptr< const freq_grid_t > bgrid( const int n_dense, const int n_eff, const int n_sparse ) { return std::make_shared< const freq_grid_t >( false, n_dense, n_eff, n_sparse ); }
+
+/**
+ * gf on a product of compressed frequency grids. The stored elements are kept contiguously in row-major
+ * order of the grid positions, data(), num_elements() and shape() refer to them, such that the gf_algebra,
+ * the expression templates, the norms and the checkpoints work on the compressed data. Element access by
+ * flat position addresses the stored elements, access by idx_t takes Matsubara indices and interpolates
+ * or extrapolates where the index is not stored. init and init_parallel only evaluate the stored
+ * elements. The grids are shared between all copies.
+ */
+template< typename value_t_, unsigned R >
+class gf_grid
+{
+   public:
+      static constexpr std::size_t dimensionality = R;
+      using value_t = value_t_;
+      using element = value_t;
+      using idx_t = typename gf< std::complex< double >, R >::idx_t;
+      using size_type = boost::multi_array_types::size_type;
+      using index = boost::multi_array_types::index;
+      using grids_t = std::array< std::shared_ptr< const freq_grid_t >, R >;
+
+      gf_grid( const grids_t& grids ):
+	 grids_( grids ), num_elements_( 1 )
+   {
+      for( unsigned d = 0; d < R; ++d )
+      {
+	 shape_[d] = grids_[d]->size();
+	 index_bases_[d] = 0;
+	 num_elements_ *= shape_[d];
+      }
+      data_.assign( num_elements_, value_t( 0.0 ) );
+   }
+
+      size_type num_elements() const { return num_elements_; }
+      value_t* data() { return data_.data(); }
+      const value_t* data() const { return data_.data(); }
+
+      // Extents of the stored grid positions
+      const size_type* shape() const { return shape_.data(); }
+      const index* index_bases() const { return index_bases_.data(); }
+      const freq_grid_t& grid( const unsigned d ) const { return *grids_[d]; }
+
+      // Stored elements by flat position
+      value_t& operator()( const int pos ) { return data_[pos]; }
+      const value_t& operator()( const int pos ) const { return data_[pos]; }
+
+      // Value at arbitrary Matsubara indices, multilinear interpolation between the stored elements
+      value_t operator()( const idx_t& idx ) const
+      {
+	 std::array< const freq_grid_t*, R > grids;
+	 for( unsigned d = 0; d < R; ++d )
+	    grids[d] = grids_[d].get();
+	 return grid_detail::interp( grids, idx, [this]( const int pos )->value_t{ return data_[pos]; } );
+      }
+
+      // Matsubara indices of a stored element
+      idx_t get_idx( int pos ) const
+      {
+	 idx_t idx;
+	 for( int d = R - 1; d >= 0; --d )
+	 {
+	    idx[d] = grids_[d]->index( pos % shape_[d] );
+	    pos /= shape_[d];
+	 }
+	 return idx;
+      }
+
+      // Flat position of stored Matsubara indices, -1 if one of them is not stored
+      int get_pos( const idx_t& idx ) const
+      {
+	 int pos = 0;
+	 for( unsigned d = 0; d < R; ++d )
+	 {
+	    const int p = grids_[d]->pos( idx[d] );
+	    if( p < 0 )
+	       return -1;
+	    pos = pos * shape_[d] + p;
+	 }
+	 return pos;
+      }
+
+      void init( std::function< value_t( const idx_t& idx ) > init_func )
+      {
+	 for( int pos = 0; pos < int( num_elements_ ); ++pos )
+	    data_[pos] = init_func( get_idx( pos ) );
+      }
+
+      template< typename init_func_t >
+      void init_parallel( const init_func_t& init_func )
+      {
+	 const int n = num_elements_;
+#pragma omp parallel for schedule( runtime )
+	 for( int pos = 0; pos < n; ++pos )
+	    data_[pos] = init_func( get_idx( pos ) );
+      }
+
+      gf_grid& operator+=( const gf_grid& rhs )
+      {
+	 for( size_type k = 0; k < num_elements_; ++k )
+	    data_[k] += rhs.data_[k];
+	 return *this;
+      }
+
+      gf_grid& operator-=( const gf_grid& rhs )
+      {
+	 for( size_type k = 0; k < num_elements_; ++k )
+	    data_[k] -= rhs.data_[k];
+	 return *this;
+      }
+
+      gf_grid& operator+=( const value_t& rhs )
+      {
+	 for( auto& val : data_ )
+	    val += rhs;
+	 return *this;
+      }
+
+      gf_grid& operator*=( const value_t& rhs )
+      {
+	 for( auto& val : data_ )
+	    val *= rhs;
+	 return *this;
+      }
+
+      gf_grid& operator/=( const value_t& rhs ) { return *this *= value_t( 1.0 ) / rhs; }
+
+   private:
+      grids_t grids_;
+      std::array< size_type, R > shape_;
+      std::array< index, R > index_bases_;
+      size_type num_elements_;
+      std::vector< value_t, gf_pool_allocator< value_t > > data_;
+};
+
+// Maximum norm over the stored elements, the interpolation does not exceed it inside the grids
+template< typename value_t, unsigned R >
+double norm( const gf_grid< value_t, R >& gf_obj )
+{
+   double res = 0.0;
+   for( std::size_t k = 0; k < gf_obj.num_elements(); ++k )
+      res = std::max( res, gf_elem_abs2( gf_obj.data()[k] ) );
+   return std::sqrt( res );
+}
+
+/**
+ * Value of a gf on a dense box of Matsubara indices ( gf, gf_soa or gf_sym on ffreq / bfreq ) at arbitrary
+ * indices, interpolated and extrapolated like gf_grid. box[d] describes the box along dimension d, i.e.
+ * freq_grid_t( true, n, n, 0 ) for ffreq( n ) and freq_grid_t( false, n, n, 0 ) for bfreq( n ). Used to
+ * prolong gf's onto finer grids.
+ */
+template< typename gf_t, std::size_t R, typename idx_t >
+typename gf_t::element gf_interp( const gf_t& gf_obj, const std::array< const freq_grid_t*, R >& box, const idx_t& idx )
+{
+   return grid_detail::interp( box, idx, [&gf_obj]( const int pos )->typename gf_t::element{ return gf_obj( pos ); } );
+}
+
+/**
+ * Deviation of a gf from its asymptotic form along the last ( fermionic ) frequency, relative to the
+ * maximum magnitude of the gf. In every row, the tail a + b / nu through the two outermost frequencies on
+ * either side predicts the value a few frequencies further inside, the maximum deviation from the
+ * actual value indicates that the grid ends before the asymptotic regime.
+ */
+template< typename gf_t >
+double gf_tail_deviation( const gf_t& gf_obj )
+{
+   const unsigned R = gf_t::dimensionality;
+   const int row_len = gf_obj.shape()[R - 1];
+   int rows = 1;
+   for( unsigned d = 0; d + 1 < R; ++d )
+      rows *= gf_obj.shape()[d];
+   const int probe = std::min( std::max( 2, row_len / 8 ), row_len / 2 - 1 ); 	// Distance of the compared frequency from the border
+   if( probe < 2 )
+      return 0.0;
+
+   double scale = 0.0;
+   for( int pos = 0; pos < rows * row_len; ++pos )
+      scale = std::max( scale, gf_elem_abs( typename gf_t::element( gf_obj( pos ) ) ) );
+
+   auto nu = [&gf_obj]( const int pos ){ return gf_obj.get_idx( pos )[R - 1] + 0.5; };
+   double dev = 0.0;
+   for( int r = 0; r < rows; ++r )
+      for( const int side : { 1, -1 } )
+      {
+	 const int p1 = r * row_len + ( side > 0 ? row_len - 1 : 0 ); 	// Outermost frequency
+	 const int p2 = p1 - side;
+	 const int pp = p1 - side * probe;
+	 const double x1 = 1.0 / nu( p1 ), x2 = 1.0 / nu( p2 ), xp = 1.0 / nu( pp );
+	 const auto v1 = gf_elem_promote( gf_obj( p1 ) ), v2 = gf_elem_promote( gf_obj( p2 ) ), vp = gf_elem_promote( gf_obj( pp ) );
+	 const auto pred = v1 + ( v2 - v1 ) * ( ( xp - x1 ) / ( x2 - x1 ) );
+	 dev = std::max( dev, gf_elem_abs( vp - pred ) );
+      }
+   return scale > 0.0 ? dev / scale : 0.0;
+}
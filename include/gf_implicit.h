@@ -0,0 +1,254 @@
+#pragma once
+
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+
+#include <boost/numeric/odeint/algebra/default_operations.hpp>
+#include <boost/numeric/odeint/stepper/controlled_step_result.hpp>
+#include <boost/numeric/odeint/stepper/stepper_categories.hpp>
+#include <boost/numeric/odeint/util/unwrap_reference.hpp>
+
+#include <gf_instr.h>
+#include <gf_algebra.h>
+
+/********************* Linearly implicit integration of stiff flows  ********************/
+
+namespace implicit_detail {
+
+   using boost::numeric::odeint::default_operations;
+
+   // dst = a1 * s1, elementwise through the algebra, dst may coincide with s1
+   template< typename Algebra, typename S >
+   inline void scale_sum( Algebra& algebra, S& dst, const double a1, const S& s1 )
+   { algebra.for_each2( dst, s1, default_operations::scale_sum1< double >( a1 ) ); }
+
+   // dst = a1 * s1 + a2 * s2
+   template< typename Algebra, typename S >
+   inline void scale_sum( Algebra& algebra, S& dst, const double a1, const S& s1, const double a2, const S& s2 )
+   { algebra.for_each3( dst, s1, s2, default_operations::scale_sum2< double, double >( a1, a2 ) ); }
+
+   // dst = a1 * s1 + a2 * s2 + a3 * s3
+   template< typename Algebra, typename S >
+   inline void scale_sum( Algebra& algebra, S& dst, const double a1, const S& s1, const double a2, const S& s2, const double a3, const S& s3 )
+   { algebra.for_each4( dst, s1, s2, s3, default_operations::scale_sum3< double, double, double >( a1, a2, a3 ) ); }
+
+   template< typename Algebra, typename S >
+   inline double norm2( Algebra& algebra, const S& s ) { return std::sqrt( algebra.inner_prod( s, s ) ); }
+
+} // namespace implicit_detail
+
+/**
+ * Restarted GMRES for A x = b on states, the operator A is only applied to states and never formed.
+ * The Krylov basis ( krylov_dim + 1 states ) and the Hessenberg matrix are allocated once, the inner
+ * products and linear combinations go through the algebra ( inner_prod, for_each ), such that the
+ * solver works for all storages and across MPI ranks.
+ */
+template< typename State, typename Algebra >
+class gmres_t
+{
+   public:
+      gmres_t( const std::size_t krylov_dim ):
+	 m_( krylov_dim > 0 ? krylov_dim : 1 ), v_( m_ + 1 ), h_( ( m_ + 1 ) * m_ ), cs_( m_ ), sn_( m_ ), g_( m_ + 1 ), y_( m_ )
+      {}
+
+      /**
+       * Solves apply( v, Av ) x = b up to the residual rel_tol * | b |, x holds the initial guess.
+       * Returns the number of iterations ( applications of A without the residuals ), converged is
+       * false if max_iters were exceeded.
+       */
+      template< typename Op >
+      std::size_t solve( Op& apply, State& x, const State& b, const double rel_tol, const std::size_t max_iters, bool& converged )
+      {
+	 using namespace implicit_detail;
+	 Algebra algebra;
+	 const double tol = rel_tol * norm2( algebra, b );
+	 std::size_t iters = 0;
+	 converged = false;
+
+	 for( ;; )
+	 {
+	    // Residual of the current guess starts the Krylov basis
+	    apply( x, v_[0] );
+	    scale_sum( algebra, v_[0], 1.0, b, -1.0, v_[0] );
+	    const double beta = norm2( algebra, v_[0] );
+	    if( beta <= tol )
+	    {
+	       converged = true;
+	       return iters;
+	    }
+	    if( iters >= max_iters )
+	       return iters;
+	    scale_sum( algebra, v_[0], 1.0 / beta, v_[0] );
+	    std::fill( g_.begin(), g_.end(), 0.0 );
+	    g_[0] = beta;
+
+	    // Arnoldi process with modified Gram-Schmidt, the Hessenberg matrix is reduced by Givens rotations
+	    std::size_t k = 0;
+	    double res = beta;
+	    while( k < m_ && iters < max_iters && res > tol )
+	    {
+	       apply( v_[k], v_[k + 1] );
+	       for( std::size_t j = 0; j <= k; ++j )
+	       {
+		  H( j, k ) = algebra.inner_prod( v_[j], v_[k + 1] );
+		  scale_sum( algebra, v_[k + 1], 1.0, v_[k + 1], -H( j, k ), v_[j] );
+	       }
+	       H( k + 1, k ) = norm2( algebra, v_[k + 1] );
+	       if( H( k + 1, k ) > 0.0 )
+		  scale_sum( algebra, v_[k + 1], 1.0 / H( k + 1, k ), v_[k + 1] );
+
+	       for( std::size_t j = 0; j < k; ++j )
+		  rotate( H( j, k ), H( j + 1, k ), cs_[j], sn_[j] );
+	       const double r = std::hypot( H( k, k ), H( k + 1, k ) );
+	       cs_[k] = r > 0.0 ? H( k, k ) / r : 1.0;
+	       sn_[k] = r > 0.0 ? H( k + 1, k ) / r : 0.0;
+	       rotate( H( k, k ), H( k + 1, k ), cs_[k], sn_[k] );
+	       rotate( g_[k], g_[k + 1], cs_[k], sn_[k] );
+	       res = std::abs( g_[k + 1] );
+	       ++k;
+	       ++iters;
+	    }
+
+	    // Least-squares solution of the triangular system, x += V y
+	    for( std::size_t i = k; i-- > 0; )
+	    {
+	       double sum = g_[i];
+	       for( std::size_t j = i + 1; j < k; ++j )
+		  sum -= H( i, j ) * y_[j];
+	       y_[i] = H( i, i ) != 0.0 ? sum / H( i, i ) : 0.0;
+	    }
+	    for( std::size_t j = 0; j < k; ++j )
+	       scale_sum( algebra, x, 1.0, x, y_[j], v_[j] );
+	 }
+      }
+
+   private:
+      double& H( const std::size_t i, const std::size_t j ) { return h_[ i * m_ + j ]; }
+
+      static void rotate( double& a, double& b, const double c, const double s )
+      {
+	 const double tmp = c * a + s * b;
+	 b = -s * a + c * b;
+	 a = tmp;
+      }
+
+      std::size_t m_;
+      std::vector< State > v_; 		///< Krylov basis
+      std::vector< double > h_; 		///< Hessenberg matrix, row major ( m + 1 ) x m
+      std::vector< double > cs_, sn_; 		///< Givens rotations
+      std::vector< double > g_, y_;
+};
+
+/**
+ * Adaptive Rosenbrock stepper ( ROS2, second order, L-stable, gamma = 1 + 1 / sqrt( 2 ) ) for stiff flows.
+ * The stage equations ( I - gamma h J ) k = r are solved by GMRES, where the Jacobian J of the rhs is
+ * never formed but applied by finite differences of the rhs, J v = ( f( t, x + eps v ) - f( t, x ) ) / eps.
+ * The explicit time dependence of the rhs enters by a forward difference in t. The error is estimated
+ * against the embedded first-order solution and weighted like gf_error_checker.
+ *
+ * Models odeint's controlled stepper concept ( try_step( system, x, t, dt ) ), e.g. for
+ * integrate_checkpointed. A step is rejected with a halved step size if GMRES does not converge.
+ * All stage and Krylov buffers are allocated once.
+ */
+template< typename State, typename Algebra >
+class rosenbrock_krylov_t
+{
+   public:
+      typedef State state_type;
+      typedef State deriv_type;
+      typedef double value_type;
+      typedef double time_type;
+      typedef Algebra algebra_type;
+      typedef boost::numeric::odeint::controlled_stepper_tag stepper_category;
+
+      rosenbrock_krylov_t( const double eps_abs, const double eps_rel, const std::size_t krylov_dim = 10, const double lin_tol = 1e-3, const std::size_t max_lin_iters = 100 ):
+	 eps_abs_( eps_abs ), eps_rel_( eps_rel ), lin_tol_( lin_tol ), max_lin_iters_( max_lin_iters ), gmres_( krylov_dim )
+      {}
+
+      template< typename System >
+      boost::numeric::odeint::controlled_step_result try_step( System system, State& x, double& t, double& dt )
+      {
+	 using namespace implicit_detail;
+	 using boost::numeric::odeint::success;
+	 using boost::numeric::odeint::fail;
+	 typename boost::numeric::odeint::unwrap_reference< System >::type& sys = system;
+	 Algebra algebra;
+	 const double gamma = 1.0 + 1.0 / std::sqrt( 2.0 );
+	 const double h = dt;
+	 const double sqrt_eps = std::sqrt( std::numeric_limits< double >::epsilon() );
+	 // The perturbed state is rounded to the precision of the state, e.g. complex< float > vertices ( GF_FLOAT )
+	 const double sqrt_eps_x = std::sqrt( gf_state_eps< State >() );
+
+	 sys( x, fx_, t );
+
+	 // f_t = ( f( t + delta, x ) - f( t, x ) ) / delta
+	 const double delta = sqrt_eps * std::max( std::abs( t ) + std::abs( h ), 1.0 );
+	 sys( x, ft_, t + delta );
+	 scale_sum( algebra, ft_, 1.0 / delta, ft_, -1.0 / delta, fx_ );
+
+	 // v -> ( I - gamma h J ) v with the finite-difference Jacobian at ( t, x )
+	 const double x_norm = norm2( algebra, x );
+	 auto apply = [&]( const State& v, State& Av )
+	 {
+	    const double v_norm = norm2( algebra, v );
+	    if( v_norm == 0.0 )
+	    {
+	       scale_sum( algebra, Av, 1.0, v );
+	       return;
+	    }
+	    const double eps = sqrt_eps_x * ( 1.0 + x_norm ) / v_norm;
+	    scale_sum( algebra, y_, 1.0, x, eps, v );
+	    sys( y_, fy_, t );
+	    scale_sum( algebra, Av, 1.0, v, -gamma * h / eps, fy_, gamma * h / eps, fx_ );
+	 };
+
+	 // Stage 1: ( I - gamma h J ) k1 = f( t, x ) + gamma h f_t
+	 bool converged;
+	 scale_sum( algebra, b_, 1.0, fx_, gamma * h, ft_ );
+	 scale_sum( algebra, k1_, 1.0, b_ );
+	 std::size_t iters = gmres_.solve( apply, k1_, b_, lin_tol_, max_lin_iters_, converged );
+	 if( !converged )
+	 {
+	    instr_add( instr_count::LINEAR_ITERS, iters );
+	    dt = 0.5 * h;
+	    return fail;
+	 }
+
+	 // Stage 2: ( I - gamma h J ) k2 = f( t + h, x + h k1 ) - gamma h f_t - 2 k1
+	 scale_sum( algebra, y_, 1.0, x, h, k1_ );
+	 sys( y_, fy_, t + h );
+	 scale_sum( algebra, b_, 1.0, fy_, -gamma * h, ft_, -2.0, k1_ );
+	 scale_sum( algebra, k2_, 1.0, b_ );
+	 iters += gmres_.solve( apply, k2_, b_, lin_tol_, max_lin_iters_, converged );
+	 instr_add( instr_count::LINEAR_ITERS, iters );
+	 if( !converged )
+	 {
+	    dt = 0.5 * h;
+	    return fail;
+	 }
+
+	 // Difference to the first-order solution x + h k1
+	 scale_sum( algebra, err_, 0.5 * h, k1_, 0.5 * h, k2_ );
+	 const double max_err = algebra.max_rel_error( err_, x, fx_, eps_abs_, gf_rel_tol_floor< State >( eps_rel_ ), 1.0, std::abs( h ) );
+	 if( !( max_err <= 1.0 ) )
+	 {
+	    dt = h * ( std::isfinite( max_err ) ? std::max( 0.2, 0.9 / std::sqrt( max_err ) ) : 0.2 );
+	    return fail;
+	 }
+
+	 scale_sum( algebra, x, 1.0, x, 1.5 * h, k1_, 0.5 * h, k2_ );
+	 t += h;
+	 dt = h * std::min( 5.0, 0.9 / std::sqrt( std::max( max_err, 1e-10 ) ) );
+	 return success;
+      }
+
+   private:
+      double eps_abs_, eps_rel_;
+      double lin_tol_;
+      std::size_t max_lin_iters_;
+      gmres_t< State, Algebra > gmres_;
+      State fx_, ft_, fy_, y_, b_, k1_, k2_, err_;
+};
@@ -0,0 +1,318 @@
+#pragma once
+
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <stdexcept>
+
+#include <gf_pool.h>
+
+/********************* Low-overhead instrumentation of the flow  ********************/
+
+// Event counters
+enum class instr_count{ RHS_EVALS, STEPS_ACCEPTED, STEPS_REJECTED, LINEAR_ITERS, NUM };
+
+// Timed regions, RHS: one stage of the stepper, ALGEBRA: the elementwise operations between the stages
+enum class instr_region{ RHS, ALGEBRA, STEP, CHECKPOINT, OBSERVER, NUM };
+
+constexpr const char* instr_count_names[] = { "rhs_evals", "steps_accepted", "steps_rejected", "linear_iters" };
+constexpr const char* instr_region_names[] = { "rhs", "algebra", "step", "checkpoint", "observer" };
+
+constexpr std::size_t instr_num_counts = std::size_t( instr_count::NUM );
+constexpr std::size_t instr_num_regions = std::size_t( instr_region::NUM );
+
+// Event of the Chrome trace
+struct instr_event_t
+{
+   instr_region region;
+   std::int64_t start_ns;
+   std::int64_t dur_ns;
+};
+
+// Totals over all threads
+struct instr_totals_t
+{
+   std::array< std::uint64_t, instr_num_counts > counts{};
+   std::array< std::uint64_t, instr_num_regions > region_calls{};
+   std::array< std::uint64_t, instr_num_regions > region_ns{};
+};
+
+/**
+ * Counters and timers of one thread. Only the owning thread writes, other threads read the totals, hence
+ * plain relaxed loads and stores instead of read-modify-write operations keep the hot path free of locks
+ * and bus locking. The record is registered with the instrumentation on first use in a thread.
+ */
+class instr_thread_t
+{
+   public:
+      instr_thread_t();
+      ~instr_thread_t();
+
+      void add( const instr_count c, const std::uint64_t n = 1 ) { bump( counts_[ std::size_t( c ) ], n ); }
+
+      void add_time( const instr_region r, const std::int64_t start_ns, const std::int64_t dur_ns );
+
+      void collect( instr_totals_t& totals ) const
+      {
+	 for( std::size_t i = 0; i < instr_num_counts; ++i )
+	    totals.counts[i] += counts_[i].load( std::memory_order_relaxed );
+	 for( std::size_t i = 0; i < instr_num_regions; ++i )
+	 {
+	    totals.region_calls[i] += region_calls_[i].load( std::memory_order_relaxed );
+	    totals.region_ns[i] += region_ns_[i].load( std::memory_order_relaxed );
+	 }
+      }
+
+      const std::vector< instr_event_t >& events() const { return events_; }
+      int tid() const { return tid_; }
+
+   private:
+      static void bump( std::atomic< std::uint64_t >& c, const std::uint64_t n ) { c.store( c.load( std::memory_order_relaxed ) + n, std::memory_order_relaxed ); }
+
+      std::array< std::atomic< std::uint64_t >, instr_num_counts > counts_;
+      std::array< std::atomic< std::uint64_t >, instr_num_regions > region_calls_;
+      std::array< std::atomic< std::uint64_t >, instr_num_regions > region_ns_;
+      std::vector< instr_event_t > events_;
+      int tid_;
+};
+
+/**
+ * Process wide instrumentation: registry of the per-thread records, the current scale of the flow,
+ * optional recording of trace events and the periodic report. Reports are JSON lines, one object with
+ * the totals per report, written at most every period seconds when report() is called.
+ */
+class instr_t
+{
+   public:
+      using clock_t = std::chrono::steady_clock;
+
+      static instr_t& instance()
+      {
+	 static instr_t instr;
+	 return instr;
+      }
+
+      // Record of the calling thread
+      static instr_thread_t& local()
+      {
+	 static thread_local instr_thread_t thread;
+	 return thread;
+      }
+
+      std::int64_t now_ns() const { return std::chrono::duration_cast< std::chrono::nanoseconds >( clock_t::now() - start_ ).count(); }
+
+      void set_scale( const double t ) { scale_.store( t, std::memory_order_relaxed ); }
+      double scale() const { return scale_.load( std::memory_order_relaxed ); }
+
+      // Record trace events, at most max_events per thread
+      void enable_trace( const std::size_t max_events = 1 << 20 ) { max_events_.store( max_events, std::memory_order_relaxed ); }
+      std::size_t max_events() const { return max_events_.load( std::memory_order_relaxed ); }
+
+      // Periodic report to fname ( JSON lines ), every period seconds at most
+      void enable_report( const std::string& fname, const double period )
+      {
+	 std::lock_guard< std::mutex > lock( mutex_ );
+	 if( report_file_ != nullptr )
+	    std::fclose( report_file_ );
+	 report_file_ = std::fopen( fname.c_str(), "w" );
+	 if( report_file_ == nullptr )
+	    throw std::runtime_error( "instrumentation: can not open " + fname );
+	 period_ns_ = std::int64_t( period * 1e9 );
+	 last_report_ns_ = now_ns();
+      }
+
+      instr_totals_t totals() const
+      {
+	 std::lock_guard< std::mutex > lock( mutex_ );
+	 instr_totals_t res = retired_;
+	 for( const instr_thread_t* thread : threads_ )
+	    thread->collect( res );
+	 return res;
+      }
+
+      // Writes a report if the period elapsed ( or force ), cheap otherwise
+      void report( const bool force = false )
+      {
+	 if( report_file_ == nullptr )
+	    return;
+	 const std::int64_t now = now_ns();
+	 if( !force && now - last_report_ns_ < period_ns_ )
+	    return;
+	 last_report_ns_ = now;
+	 write_json( report_file_, totals(), now );
+	 std::fflush( report_file_ );
+      }
+
+      // JSON object with all counters, region timings, the scale and the gf_pool statistics
+      void write_json( std::FILE* f, const instr_totals_t& tot, const std::int64_t now ) const
+      {
+	 const gf_pool_stats_t pool = gf_pool_stats();
+	 std::fprintf( f, "{\"time_s\":%.6f,\"scale\":%.10g", now * 1e-9, scale() );
+	 for( std::size_t i = 0; i < instr_num_counts; ++i )
+	    std::fprintf( f, ",\"%s\":%llu", instr_count_names[i], ( unsigned long long ) tot.counts[i] );
+	 for( std::size_t i = 0; i < instr_num_regions; ++i )
+	    std::fprintf( f, ",\"%s_calls\":%llu,\"%s_s\":%.6f", instr_region_names[i], ( unsigned long long ) tot.region_calls[i], instr_region_names[i], tot.region_ns[i] * 1e-9 );
+	 std::fprintf( f, ",\"pool_requests\":%zu,\"pool_hits\":%zu,\"bytes_in_use\":%zu,\"peak_bytes\":%zu}\n",
+	       pool.requests, pool.hits, pool.bytes_in_use, pool.peak_bytes );
+      }
+
+      // Chrome trace-event file ( chrome://tracing, Perfetto ), to be written when no region is active
+      void write_trace( const std::string& fname ) const
+      {
+	 std::FILE* f = std::fopen( fname.c_str(), "w" );
+	 if( f == nullptr )
+	    throw std::runtime_error( "instrumentation: can not open " + fname );
+	 std::lock_guard< std::mutex > lock( mutex_ );
+	 std::fprintf( f, "{\"traceEvents\":[" );
+	 bool first = true;
+	 for( const instr_thread_t* thread : threads_ )
+	    for( const instr_event_t& ev : thread->events() )
+	    {
+	       std::fprintf( f, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", first ? "" : ",",
+		     instr_region_names[ std::size_t( ev.region ) ], thread->tid(), ev.start_ns * 1e-3, ev.dur_ns * 1e-3 );
+	       first = false;
+	    }
+	 std::fprintf( f, "\n]}\n" );
+	 std::fclose( f );
+      }
+
+      void register_thread( instr_thread_t* thread, int& tid )
+      {
+	 std::lock_guard< std::mutex > lock( mutex_ );
+	 threads_.push_back( thread );
+	 tid = next_tid_++;
+      }
+
+      // Counts of finished threads are kept
+      void unregister_thread( instr_thread_t* thread )
+      {
+	 std::lock_guard< std::mutex > lock( mutex_ );
+	 thread->collect( retired_ );
+	 threads_.erase( std::remove( threads_.begin(), threads_.end(), thread ), threads_.end() );
+      }
+
+      ~instr_t()
+      {
+	 if( report_file_ != nullptr )
+	    std::fclose( report_file_ );
+      }
+
+      instr_t( const instr_t& ) = delete;
+      instr_t& operator=( const instr_t& ) = delete;
+
+   private:
+      instr_t():
+	 start_( clock_t::now() ), scale_( 0.0 ), max_events_( 0 ), report_file_( nullptr ), period_ns_( 0 ), last_report_ns_( 0 ), next_tid_( 0 )
+   {}
+
+      const clock_t::time_point start_;
+      std::atomic< double > scale_;
+      std::atomic< std::size_t > max_events_;
+      std::FILE* report_file_;
+      std::int64_t period_ns_;
+      std::int64_t last_report_ns_;
+      mutable std::mutex mutex_;
+      std::vector< instr_thread_t* > threads_;
+      instr_totals_t retired_;
+      int next_tid_;
+};
+
+inline instr_thread_t::instr_thread_t()
+{
+   for( auto& c : counts_ ) c.store( 0, std::memory_order_relaxed );
+   for( auto& c : region_calls_ ) c.store( 0, std::memory_order_relaxed );
+   for( auto& c : region_ns_ ) c.store( 0, std::memory_order_relaxed );
+   instr_t::instance().register_thread( this, tid_ );
+}
+
+inline instr_thread_t::~instr_thread_t() { instr_t::instance().unregister_thread( this ); }
+
+inline void instr_thread_t::add_time( const instr_region r, const std::int64_t start_ns, const std::int64_t dur_ns )
+{
+   bump( region_calls_[ std::size_t( r ) ], 1 );
+   bump( region_ns_[ std::size_t( r ) ], dur_ns );
+   if( events_.size() < instr_t::instance().max_events() )
+      events_.push_back( instr_event_t{ r, start_ns, dur_ns } );
+}
+
+// Shorthands for the hot path
+inline void instr_add( const instr_count c, const std::uint64_t n = 1 ) { instr_t::local().add( c, n ); }
+inline void instr_set_scale( const double t ) { instr_t::instance().set_scale( t ); }
+
+// Times the enclosing scope as a region
+class instr_scope_t
+{
+   public:
+      instr_scope_t( const instr_region region ):
+	 region_( region ), start_ns_( instr_t::instance().now_ns() )
+   {}
+
+      ~instr_scope_t() { instr_t::local().add_time( region_, start_ns_, instr_t::instance().now_ns() - start_ns_ ); }
+
+      instr_scope_t( const instr_scope_t& ) = delete;
+      instr_scope_t& operator=( const instr_scope_t& ) = delete;
+
+   private:
+      const instr_region region_;
+      const std::int64_t start_ns_;
+};
+
+/**
+ * Algebra timing the elementwise operations of the base algebra as instr_region::ALGEBRA, e.g.
+ * mpi_algebra< instr_algebra< gf_algebra > >. Together with the timed rhs this splits each stage
+ * of the stepper into the rhs evaluation and the linear combination of the stage states.
+ */
+template< typename algebra_t >
+struct instr_algebra : public algebra_t
+{
+   template< class S1, class Op >
+   static void for_each1( S1& s1, Op op )
+   { instr_scope_t scope( instr_region::ALGEBRA ); algebra_t::for_each1( s1, op ); }
+
+   template< class S1, class S2, class Op >
+   static void for_each2( S1& s1, S2& s2, Op op )
+   { instr_scope_t scope( instr_region::ALGEBRA ); algebra_t::for_each2( s1, s2, op ); }
+
+   template< class S1, class S2, class S3, class Op >
+   static void for_each3( S1& s1, S2& s2, S3& s3, Op op )
+   { instr_scope_t scope( instr_region::ALGEBRA ); algebra_t::for_each3( s1, s2, s3, op ); }
+
+   template< class S1, class S2, class S3, class S4, class Op >
+   static void for_each4( S1& s1, S2& s2, S3& s3, S4& s4, Op op )
+   { instr_scope_t scope( instr_region::ALGEBRA ); algebra_t::for_each4( s1, s2, s3, s4, op ); }
+
+   template< class S1, class S2, class S3, class S4, class S5, class Op >
+   static void for_each5( S1& s1, S2& s2, S3& s3, S4& s4, S5& s5, Op op )
+   { instr_scope_t scope( instr_region::ALGEBRA ); algebra_t::for_each5( s1, s2, s3, s4, s5, op ); }
+
+   template< class S1, class S2, class S3, class S4, class S5, class S6, class Op >
+   static void for_each6( S1& s1, S2& s2, S3& s3, S4& s4, S5& s5, S6& s6, Op op )
+   { instr_scope_t scope( instr_region::ALGEBRA ); algebra_t::for_each6( s1, s2, s3, s4, s5, s6, op ); }
+
+   template< class S1, class S2, class S3, class S4, class S5, class S6, class S7, class Op >
+   static void for_each7( S1& s1, S2& s2, S3& s3, S4& s4, S5& s5, S6& s6, S7& s7, Op op )
+   { instr_scope_t scope( instr_region::ALGEBRA ); algebra_t::for_each7( s1, s2, s3, s4, s5, s6, s7, op ); }
+
+   template< class S1, class S2, class S3, class S4, class S5, class S6, class S7, class S8, class Op >
+   static void for_each8( S1& s1, S2& s2, S3& s3, S4& s4, S5& s5, S6& s6, S7& s7, S8& s8, Op op )
+   { instr_scope_t scope( instr_region::ALGEBRA ); algebra_t::for_each8( s1, s2, s3, s4, s5, s6, s7, s8, op ); }
+
+   template< class S >
+   static double norm_inf( const S& s )
+   { instr_scope_t scope( instr_region::ALGEBRA ); return algebra_t::norm_inf( s ); }
+
+   template< class S1, class S2, class S3 >
+   static double max_rel_error( const S1& err, const S2& x, const S3& dxdt, const double eps_abs, const double eps_rel, const double a_x, const double a_dxdt )
+   { instr_scope_t scope( instr_region::ALGEBRA ); return algebra_t::max_rel_error( err, x, dxdt, eps_abs, eps_rel, a_x, a_dxdt ); }
+
+   template< class S1, class S2 >
+   static double inner_prod( const S1& s1, const S2& s2 )
+   { instr_scope_t scope( instr_region::ALGEBRA ); return algebra_t::inner_prod( s1, s2 ); }
+};
@@ -0,0 +1,373 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <complex>
+#include <cstdlib>
+#include <cstring>
+#include <cstddef>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+#include <functional>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+
+#include <boost/multi_array.hpp>
+
+#include <gf.h>
+#include <gf_algebra.h>
+
+/********************* Out-of-core storage of gf's in memory-mapped files  ********************/
+
+namespace mmap_detail {
+
+   inline std::string& dir()
+   {
+      static std::string d;
+      return d;
+   }
+
+   inline std::mutex& dir_mutex()
+   {
+      static std::mutex m;
+      return m;
+   }
+
+   // Shared writable map of an anonymous file in the mmap directory. The file is unlinked right after its
+   // creation, such that it disappears with the map, also if the process is killed
+   class mapped_buffer_t
+   {
+      public:
+	 mapped_buffer_t():
+	    fd_( -1 ), data_( nullptr ), bytes_( 0 )
+	 {}
+
+	 explicit mapped_buffer_t( const std::size_t bytes ):
+	    mapped_buffer_t()
+	 {
+	    std::string path;
+	    {
+	       std::lock_guard< std::mutex > lock( dir_mutex() );
+	       path = dir();
+	    }
+	    if( path.empty() )
+	    {
+	       const char* tmp = std::getenv( "TMPDIR" );
+	       path = tmp != nullptr ? tmp : "/tmp";
+	    }
+	    path += "/gf_mmap.XXXXXX";
+
+	    std::vector< char > name( path.begin(), path.end() );
+	    name.push_back( '\0' );
+	    fd_ = mkstemp( name.data() );
+	    if( fd_ < 0 )
+	       throw std::runtime_error( "gf_mmap: can not create " + path );
+	    unlink( name.data() );
+
+	    bytes_ = std::max< std::size_t >( bytes, 1 );
+	    if( ftruncate( fd_, bytes_ ) != 0 )
+	    {
+	       close( fd_ );
+	       throw std::runtime_error( "gf_mmap: can not resize " + path );
+	    }
+	    void* p = mmap( nullptr, bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0 );
+	    if( p == MAP_FAILED )
+	    {
+	       close( fd_ );
+	       throw std::runtime_error( "gf_mmap: can not map " + path );
+	    }
+	    data_ = static_cast< char* >( p );
+
+	    // The algebra streams the storage front to back once per stage: aggressive read-ahead, pages behind
+	    // the traversal are released first under memory pressure
+	    madvise( data_, bytes_, MADV_SEQUENTIAL );
+	 }
+
+	 ~mapped_buffer_t()
+	 {
+	    if( data_ != nullptr )
+	       munmap( data_, bytes_ );
+	    if( fd_ >= 0 )
+	       close( fd_ );
+	 }
+
+	 mapped_buffer_t( mapped_buffer_t&& obj ):
+	    fd_( obj.fd_ ), data_( obj.data_ ), bytes_( obj.bytes_ )
+	 {
+	    obj.fd_ = -1;
+	    obj.data_ = nullptr;
+	    obj.bytes_ = 0;
+	 }
+
+	 mapped_buffer_t& operator=( mapped_buffer_t&& obj )
+	 {
+	    std::swap( fd_, obj.fd_ );
+	    std::swap( data_, obj.data_ );
+	    std::swap( bytes_, obj.bytes_ );
+	    return *this;
+	 }
+
+	 mapped_buffer_t( const mapped_buffer_t& ) = delete;
+	 mapped_buffer_t& operator=( const mapped_buffer_t& ) = delete;
+
+	 char* data() const { return data_; }
+	 std::size_t bytes() const { return bytes_; }
+	 int fd() const { return fd_; }
+
+	 // Page-aligned range around [ first, first + len ) within the map
+	 void advise( const std::size_t first, const std::size_t len, const int advice ) const
+	 {
+	    const std::size_t page = sysconf( _SC_PAGESIZE );
+	    const std::size_t lo = first / page * page;
+	    const std::size_t hi = std::min( first + len, bytes_ );
+	    if( data_ != nullptr && hi > lo )
+	       madvise( data_ + lo, hi - lo, advice );
+	 }
+
+      private:
+	 int fd_;
+	 char* data_;
+	 std::size_t bytes_;
+   };
+
+#ifdef MADV_COLD
+   constexpr int madv_cold = MADV_COLD;
+#else
+   constexpr int madv_cold = MADV_DONTNEED; 	// Shared file map: the pages are dropped, the file keeps the elements
+#endif
+
+} // namespace mmap_detail
+
+// Directory of the files backing gf_mmap storage, empty: TMPDIR or /tmp. Applies to gf's created afterwards
+inline void set_gf_mmap_dir( const std::string& dir )
+{
+   std::lock_guard< std::mutex > lock( mmap_detail::dir_mutex() );
+   mmap_detail::dir() = dir;
+}
+
+/**
+ * Dense gf ( row-major, like gf ) whose elements live in a memory-mapped file instead of the heap, such
+ * that the gf is limited by the disk instead of the RAM. The page cache holds the recently used parts,
+ * the kernel writes back and evicts the rest. The map is advised sequential, matching the algebra, which
+ * streams every state front to back once per stage; prefetch() and release() advise parts of the
+ * storage ahead of and behind a traversal. The algebra and init_parallel, init_rows and init_tiles call
+ * them per window of rows, see gf_for_windows.
+ *
+ * Since data(), num_elements(), shape() and index_bases() describe the contiguous storage, the algebra,
+ * the expression templates, init_parallel, the checkpoints and the MPI transfers work unchanged. Each
+ * gf maps its own unlinked file in the directory set by set_gf_mmap_dir, copies copy the elements.
+ * snapshot() writes the elements to a file, as a copy-on-write clone of the backing file where the
+ * filesystem supports it ( e.g. btrfs, xfs ), such that the snapshot costs no copy. The checkpoints
+ * write gf_mmap members this way.
+ */
+template< typename value_t_, unsigned R >
+class gf_mmap
+{
+   public:
+      static constexpr std::size_t dimensionality = R;
+      using value_t = value_t_;
+      using element = value_t;
+      using idx_t = typename gf< std::complex< double >, R >::idx_t;
+      using size_type = boost::multi_array_types::size_type;
+      using index = boost::multi_array_types::index;
+
+      template< typename Ext, typename = decltype( std::declval< const Ext& >().ranges_ ) >
+      gf_mmap( const Ext& ext ):
+	 num_elements_( 1 )
+   {
+      for( unsigned d = 0; d < R; ++d )
+      {
+	 shape_[d] = ext.ranges_[d].size();
+	 index_bases_[d] = ext.ranges_[d].start();
+	 num_elements_ *= shape_[d];
+      }
+      buf_ = mmap_detail::mapped_buffer_t( num_elements_ * sizeof( value_t ) );
+      data_ = reinterpret_cast< value_t* >( buf_.data() ); 	// The file starts out zero
+   }
+
+      gf_mmap( const gf_mmap& obj ):
+	 shape_( obj.shape_ ), index_bases_( obj.index_bases_ ), num_elements_( obj.num_elements_ ),
+	 buf_( num_elements_ * sizeof( value_t ) ), data_( reinterpret_cast< value_t* >( buf_.data() ) )
+   {
+      std::copy( obj.data_, obj.data_ + num_elements_, data_ );
+   }
+
+      gf_mmap( gf_mmap&& obj ):
+	 shape_( obj.shape_ ), index_bases_( obj.index_bases_ ), num_elements_( obj.num_elements_ ),
+	 buf_( std::move( obj.buf_ ) ), data_( obj.data_ )
+   {
+      obj.num_elements_ = 0;
+      obj.data_ = nullptr;
+   }
+
+      // Assignment between gf's of equal extents copies into the existing map
+      gf_mmap& operator=( const gf_mmap& obj )
+      {
+	 if( this == &obj )
+	    return *this;
+	 if( num_elements_ != obj.num_elements_ )
+	    return *this = gf_mmap( obj );
+	 shape_ = obj.shape_;
+	 index_bases_ = obj.index_bases_;
+	 std::copy( obj.data_, obj.data_ + num_elements_, data_ );
+	 return *this;
+      }
+
+      gf_mmap& operator=( gf_mmap&& obj )
+      {
+	 std::swap( shape_, obj.shape_ );
+	 std::swap( index_bases_, obj.index_bases_ );
+	 std::swap( num_elements_, obj.num_elements_ );
+	 std::swap( buf_, obj.buf_ );
+	 std::swap( data_, obj.data_ );
+	 return *this;
+      }
+
+      size_type num_elements() const { return num_elements_; }
+      value_t* data() { return data_; }
+      const value_t* data() const { return data_; }
+      const size_type* shape() const { return shape_.data(); }
+      const index* index_bases() const { return index_bases_.data(); }
+
+      // Elements by flat position
+      value_t& operator()( const int pos ) { return data_[pos]; }
+      const value_t& operator()( const int pos ) const { return data_[pos]; }
+
+      // Elements by frequency indices
+      value_t& operator()( const idx_t& idx ) { return data_[ get_pos( idx ) ]; }
+      const value_t& operator()( const idx_t& idx ) const { return data_[ get_pos( idx ) ]; }
+
+      idx_t get_idx( long pos ) const
+      {
+	 idx_t idx;
+	 for( int d = R - 1; d >= 0; --d )
+	 {
+	    idx[d] = pos % shape_[d] + index_bases_[d];
+	    pos /= shape_[d];
+	 }
+	 return idx;
+      }
+
+      long get_pos( const idx_t& idx ) const
+      {
+	 long pos = 0;
+	 for( unsigned d = 0; d < R; ++d )
+	    pos = pos * shape_[d] + ( idx[d] - index_bases_[d] );
+	 return pos;
+      }
+
+      void init( std::function< value_t( const idx_t& idx ) > init_func )
+      {
+	 for( long pos = 0; pos < long( num_elements_ ); ++pos )
+	    data_[pos] = init_func( get_idx( pos ) );
+      }
+
+      // Read-ahead of count elements from first on, e.g. the rows a traversal reaches next
+      void prefetch( const std::size_t first, const std::size_t count ) const { buf_.advise( first * sizeof( value_t ), count * sizeof( value_t ), MADV_WILLNEED ); }
+
+      // Elements that are not needed soon, their pages are written back and dropped from the page cache first
+      void release( const std::size_t first, const std::size_t count ) const { buf_.advise( first * sizeof( value_t ), count * sizeof( value_t ), mmap_detail::madv_cold ); }
+
+      // Elements written ( raw, row-major ) to the open file fd at offset, as a reflink of the backing file where the
+      // filesystem supports it and offset is aligned to its blocks ( e.g. the page-aligned members of the checkpoints )
+      void snapshot( const int fd, const std::size_t offset ) const
+      {
+	 const std::size_t bytes = num_elements_ * sizeof( value_t );
+	 bool done = false;
+#ifdef FICLONERANGE
+	 const std::size_t page = sysconf( _SC_PAGESIZE );
+	 if( bytes > 0 && offset % page == 0 && msync( buf_.data(), buf_.bytes(), MS_SYNC ) == 0 )
+	 {
+	    file_clone_range range;
+	    range.src_fd = buf_.fd();
+	    range.src_offset = 0;
+	    range.src_length = bytes; 		// Up to the end of the backing file, which needs no alignment
+	    range.dest_offset = offset;
+	    done = ioctl( fd, FICLONERANGE, &range ) == 0;
+	 }
+#endif
+	 const char* p = reinterpret_cast< const char* >( data_ );
+	 for( std::size_t written = 0; !done && written < bytes; )
+	 {
+	    const ssize_t n = pwrite( fd, p + written, bytes - written, offset + written );
+	    if( n <= 0 )
+	       throw std::runtime_error( "gf_mmap: can not write the snapshot" );
+	    written += n;
+	 }
+      }
+
+      // Elements written to fname ( raw, row-major ), a reflink of the backing file where supported
+      void snapshot( const std::string& fname ) const
+      {
+	 const int fd = open( fname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+	 if( fd < 0 )
+	    throw std::runtime_error( "gf_mmap: can not open " + fname );
+	 try
+	 {
+	    snapshot( fd, 0 );
+	 }
+	 catch( const std::runtime_error& )
+	 {
+	    close( fd );
+	    throw std::runtime_error( "gf_mmap: can not write " + fname );
+	 }
+	 close( fd );
+      }
+
+      gf_mmap& operator+=( const gf_mmap& rhs )
+      {
+	 for( size_type k = 0; k < num_elements_; ++k )
+	    data_[k] += rhs.data_[k];
+	 return *this;
+      }
+
+      gf_mmap& operator-=( const gf_mmap& rhs )
+      {
+	 for( size_type k = 0; k < num_elements_; ++k )
+	    data_[k] -= rhs.data_[k];
+	 return *this;
+      }
+
+      gf_mmap& operator+=( const value_t& rhs )
+      {
+	 for( size_type k = 0; k < num_elements_; ++k )
+	    data_[k] += rhs;
+	 return *this;
+      }
+
+      gf_mmap& operator*=( const value_t& rhs )
+      {
+	 for( size_type k = 0; k < num_elements_; ++k )
+	    data_[k] *= rhs;
+	 return *this;
+      }
+
+      gf_mmap& operator/=( const value_t& rhs ) { return *this *= value_t( 1.0 ) / rhs; }
+
+   private:
+      std::array< size_type, R > shape_;
+      std::array< index, R > index_bases_;
+      size_type num_elements_;
+      mmap_detail::mapped_buffer_t buf_;
+      value_t* data_ = nullptr;
+};
+
+// Maximum norm
+template< typename value_t, unsigned R >
+double norm( const gf_mmap< value_t, R >& gf_obj )
+{
+   double res = 0.0;
+   for( std::size_t k = 0; k < gf_obj.num_elements(); ++k )
+      res = std::max( res, gf_elem_abs2( gf_obj.data()[k] ) );
+   return std::sqrt( res );
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstddef>
+#include <algorithm>
+
+#include <boost/multi_array.hpp>
+
+#ifdef MPI_PARALLEL
+#include <mpi.h>
+#endif
+
+#include <gf_algebra.h>
+
+/********************* MPI distribution of gf's along their first (bosonic) index  ********************/
+
+// Each rank integrates its slab of the vertex, only the norms, errors and inner products of the stepper are
+// reduced over the ranks. The rhs has no frequency sums coupling the slabs, hence no rows are exchanged
+
+// Initializes and finalizes MPI for the lifetime of the object, no-op without MPI_PARALLEL
+class mpi_env_t
+{
+   public:
+      mpi_env_t( int& argc, char**& argv )
+      {
+#ifdef MPI_PARALLEL
+	 MPI_Init( &argc, &argv );
+#else
+	 (void)argc;
+	 (void)argv;
+#endif
+      }
+      ~mpi_env_t()
+      {
+#ifdef MPI_PARALLEL
+	 MPI_Finalize();
+#endif
+      }
+      mpi_env_t( const mpi_env_t& ) = delete;
+      mpi_env_t& operator=( const mpi_env_t& ) = delete;
+};
+
+inline int mpi_rank()
+{
+   int rank = 0;
+#ifdef MPI_PARALLEL
+   MPI_Comm_rank( MPI_COMM_WORLD, &rank );
+#endif
+   return rank;
+}
+
+inline int mpi_size()
+{
+   int size = 1;
+#ifdef MPI_PARALLEL
+   MPI_Comm_size( MPI_COMM_WORLD, &size );
+#endif
+   return size;
+}
+
+inline bool mpi_is_root() { return mpi_rank() == 0; }
+
+// Global maximum of val over all ranks
+inline double mpi_max( double val )
+{
+#ifdef MPI_PARALLEL
+   MPI_Allreduce( MPI_IN_PLACE, &val, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD );
+#endif
+   return val;
+}
+
+// Global sum of val over all ranks
+inline double mpi_sum( double val )
+{
+#ifdef MPI_PARALLEL
+   MPI_Allreduce( MPI_IN_PLACE, &val, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD );
+#endif
+   return val;
+}
+
+/**
+ * Contiguous block partition of an index range over the MPI ranks. Each rank owns the indices
+ * [ lo(), hi() ), local_range() can directly be used as the extent of the distributed gf dimension,
+ * such that the gf keeps global index values. Without MPI the full range is owned by the single rank.
+ */
+class slab_t
+{
+   public:
+      using range_t = boost::multi_array_types::extent_range;
+
+      slab_t( const range_t& global_range ):
+	 start_( global_range.start() ), finish_( global_range.finish() ), size_( mpi_size() ), rank_( mpi_rank() )
+   {}
+
+      int lo( int rank ) const
+      {
+	 const int n = finish_ - start_;
+	 return start_ + rank * ( n / size_ ) + std::min( rank, n % size_ );
+      }
+      int hi( int rank ) const { return lo( rank + 1 ); }
+
+      int lo() const { return lo( rank_ ); }
+      int hi() const { return hi( rank_ ); }
+
+      range_t local_range() const { return range_t( lo(), hi() ); }
+      range_t global_range() const { return range_t( start_, finish_ ); }
+
+      int size() const { return size_; }
+      int rank() const { return rank_; }
+
+   private:
+      int start_, finish_, size_, rank_;
+};
+
+/**
+ * Algebra for states distributed over the MPI ranks. The maximum norm and the maximum error of the base
+ * algebra are reduced over all ranks, such that the error checker of the controlled stepper takes the
+ * same decision on every rank. Replicated members ( e.g. Sig ) enter the maximum identically on every rank,
+ * the inner product counts them once per rank, which is still an inner product and the same on all ranks.
+ */
+template< typename algebra_t >
+struct mpi_algebra : public algebra_t
+{
+   template< class S >
+   static double norm_inf( const S& s )
+   { return mpi_max( algebra_t::norm_inf( s ) ); }
+
+   template< class S1, class S2, class S3 >
+   static double max_rel_error( const S1& err, const S2& x, const S3& dxdt, const double eps_abs, const double eps_rel, const double a_x, const double a_dxdt )
+   { return mpi_max( algebra_t::max_rel_error( err, x, dxdt, eps_abs, eps_rel, a_x, a_dxdt ) ); }
+
+   template< class S1, class S2 >
+   static double inner_prod( const S1& s1, const S2& s2 )
+   { return mpi_sum( algebra_t::inner_prod( s1, s2 ) ); }
+};
+
+using mpi_gf_algebra = mpi_algebra< gf_algebra >;
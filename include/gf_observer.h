@@ -0,0 +1,212 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#include <arithmetic_tuple.h>
+#include <gf_mpi.h>
+#include <gf_checkpoint.h>
+
+/********************* Asynchronous recording of the flow trajectory  ********************/
+
+/**
+ * Trajectory file layout ( native byte order ), one file per MPI rank:
+ *   trj_header_t, member descriptions as in the checkpoints ( chk_member_t, shape, index_bases ), padding
+ *   chunks: trj_chunk_t, snapshots
+ *   snapshot: trj_record_t, padding, elements of every member ( each starting at a multiple of 64 bytes )
+ * Header, chunks and snapshots are padded to multiples of 64 bytes, all snapshots have the same size.
+ * The file is only appended to, a chunk is complete once its trj_chunk_t and all snapshots are written.
+ * When appending after a restart, the snapshots between the checkpoint and the interruption appear twice.
+ */
+namespace trj_detail {
+
+   constexpr char magic[8] = { 'G', 'F', 'T', 'R', 'J', '0', '0', '1' };
+
+   struct trj_header_t
+   {
+      char magic[8];
+      std::uint64_t num_members;
+      std::uint64_t snapshot_bytes; 	///< Bytes per snapshot including the record and padding
+      std::uint64_t header_bytes; 	///< Bytes of the header including the member descriptions and padding
+   };
+
+   struct trj_chunk_t
+   {
+      std::uint64_t num_snapshots;
+      std::uint64_t pad[7];
+   };
+
+   struct trj_record_t
+   {
+      double t; 			///< Scale of the snapshot
+      std::uint64_t step; 		///< Number of the observer call
+   };
+
+} // namespace trj_detail
+
+/**
+ * Records snapshots of a state ( e.g. state_t ) into an append-only, chunked binary trajectory file.
+ * The integration thread only copies the state into a preallocated slot of a single-producer /
+ * single-consumer ring buffer, a background thread drains the ring and writes complete chunks. The
+ * producer never blocks: if the writer falls behind and all slots are occupied, the snapshot is dropped
+ * and counted. Every stride-th observer call is recorded. Pass observer() to the integrate functions.
+ *
+ * The slots hold complete snapshots, their number follows from the memory budget buffer_bytes ( at most
+ * 16, at least one even if a single snapshot exceeds the budget ).
+ */
+template< typename State >
+class trajectory_writer_t
+{
+   public:
+      trajectory_writer_t( const std::string& fname, const State& x, const int stride = 1, const std::size_t buffer_bytes = std::size_t( 256 ) << 20, const bool append = false ):
+	 fname_( mpi_size() > 1 ? fname + "." + std::to_string( mpi_rank() ) : fname ), stride_( stride > 0 ? stride : 1 ),
+	 head_( 0 ), tail_( 0 ), calls_( 0 ), dropped_( 0 ), stop_( false ), failed_( false )
+   {
+      using namespace chk_detail;
+      using namespace trj_detail;
+      constexpr std::size_t num_members = ReaK::arithmetic_tuple_size< State >::value;
+
+      // Size of a snapshot, the slots keep their capacity such that recording does not allocate
+      std::vector< char > snap;
+      append_record( snap, 0.0, 0 );
+      members_impl< 0, num_members >::write_data( snap, x );
+      snapshot_bytes_ = aligned( snap.size() );
+      const std::size_t max_slots = 16;
+      slots_.resize( std::max< std::size_t >( 1, std::min( max_slots, buffer_bytes / snapshot_bytes_ ) ) );
+      for( auto& slot : slots_ )
+	 slot.reserve( snapshot_bytes_ );
+
+      std::vector< char > header;
+      trj_header_t head;
+      std::memcpy( head.magic, trj_detail::magic, sizeof( head.magic ) );
+      head.num_members = num_members;
+      head.snapshot_bytes = snapshot_bytes_;
+      head.header_bytes = 0;
+      chk_detail::append( header, head );
+      members_impl< 0, num_members >::write_info( header, x );
+      header.resize( aligned( header.size() ), 0 );
+      reinterpret_cast< trj_header_t* >( header.data() )->header_bytes = header.size();
+
+      file_ = std::fopen( fname_.c_str(), append ? "ab" : "wb" );
+      if( file_ == nullptr )
+	 throw std::runtime_error( "trajectory: can not open " + fname_ );
+      std::fseek( file_, 0, SEEK_END );
+      if( std::ftell( file_ ) == 0 && std::fwrite( header.data(), 1, header.size(), file_ ) != header.size() )
+      {
+	 std::fclose( file_ );
+	 throw std::runtime_error( "trajectory: can not write " + fname_ );
+      }
+      std::fflush( file_ );
+
+      writer_ = std::thread( &trajectory_writer_t::drain, this );
+   }
+
+      ~trajectory_writer_t()
+      {
+	 finish();
+	 std::fclose( file_ );
+      }
+
+      // Writes the remaining snapshots and stops the writer thread, afterwards written(), dropped() and failed() are final
+      void finish()
+      {
+	 stop_.store( true, std::memory_order_release );
+	 if( writer_.joinable() )
+	    writer_.join();
+	 std::fflush( file_ );
+      }
+
+      trajectory_writer_t( const trajectory_writer_t& ) = delete;
+      trajectory_writer_t& operator=( const trajectory_writer_t& ) = delete;
+
+      // Called by the integration thread only
+      void record( const State& x, const double t )
+      {
+	 const std::uint64_t call = calls_++;
+	 if( call % stride_ != 0 )
+	    return;
+
+	 const std::size_t head = head_.load( std::memory_order_relaxed );
+	 if( head - tail_.load( std::memory_order_acquire ) == slots_.size() )
+	 {
+	    dropped_.fetch_add( 1, std::memory_order_relaxed );
+	    return;
+	 }
+	 std::vector< char >& slot = slots_[ head % slots_.size() ];
+	 slot.clear();
+	 append_record( slot, t, call );
+	 chk_detail::members_impl< 0, ReaK::arithmetic_tuple_size< State >::value >::write_data( slot, x );
+	 slot.resize( snapshot_bytes_, 0 );
+	 head_.store( head + 1, std::memory_order_release );
+      }
+
+      // Odeint observer, a lightweight handle to the writer, records nothing without a writer
+      struct observer_t
+      {
+	 trajectory_writer_t* writer;
+	 void operator()( const State& x, const double t ) const { if( writer ) writer->record( x, t ); }
+      };
+
+      observer_t observer() { return observer_t{ this }; }
+
+      std::size_t slots() const { return slots_.size(); } 					///< Snapshots buffered at most
+      std::size_t written() const { return tail_.load( std::memory_order_acquire ); } 	///< Snapshots written so far
+      std::size_t dropped() const { return dropped_.load( std::memory_order_relaxed ); } 	///< Snapshots lost due to a full ring
+      bool failed() const { return failed_.load( std::memory_order_relaxed ); } 		///< Whether a write to the file failed
+      const std::string& fname() const { return fname_; }
+
+   private:
+      static void append_record( std::vector< char >& buf, const double t, const std::uint64_t step )
+      {
+	 chk_detail::append( buf, trj_detail::trj_record_t{ t, step } );
+      }
+
+      // Writer thread, collects all filled slots into one chunk
+      void drain()
+      {
+	 for( ;; )
+	 {
+	    const bool stop = stop_.load( std::memory_order_acquire );
+	    const std::size_t tail = tail_.load( std::memory_order_relaxed );
+	    const std::size_t head = head_.load( std::memory_order_acquire );
+	    if( head == tail )
+	    {
+	       if( stop )
+		  return;
+	       std::this_thread::sleep_for( std::chrono::microseconds( 200 ) );
+	       continue;
+	    }
+
+	    trj_detail::trj_chunk_t chunk = {};
+	    chunk.num_snapshots = head - tail;
+	    bool ok = std::fwrite( &chunk, sizeof( chunk ), 1, file_ ) == 1;
+	    for( std::size_t i = tail; i < head; ++i )
+	       ok = ok && std::fwrite( slots_[ i % slots_.size() ].data(), 1, snapshot_bytes_, file_ ) == snapshot_bytes_;
+	    if( std::fflush( file_ ) != 0 || !ok )
+	       failed_.store( true, std::memory_order_relaxed );
+	    tail_.store( head, std::memory_order_release );
+	 }
+      }
+
+      std::string fname_;
+      std::uint64_t stride_;
+      std::size_t snapshot_bytes_;
+      std::vector< std::vector< char > > slots_;
+      std::atomic< std::size_t > head_; 		///< Next slot to be filled by the integration thread
+      std::atomic< std::size_t > tail_; 		///< Next slot to be written by the writer thread
+      std::uint64_t calls_;
+      std::atomic< std::size_t > dropped_;
+      std::atomic< bool > stop_;
+      std::atomic< bool > failed_;
+      std::FILE* file_;
+      std::thread writer_;
+};
@@ -0,0 +1,383 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+#include <initializer_list>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/********************* OpenMP parallel initialization of gf's  ********************/
+
+// Loop schedules for the parallel gf routines, all loops use schedule( runtime )
+enum class gf_schedule{ STATIC, DYNAMIC, GUIDED, AUTO };
+
+// Set the schedule and chunk size of the parallel gf loops ( chunk <= 0 : OpenMP default ), see --schedule
+// Without a call the schedule is taken from the environment variable OMP_SCHEDULE
+inline void set_gf_schedule( gf_schedule sched, int chunk = 0 )
+{
+#ifdef _OPENMP
+   switch( sched )
+   {
+      case gf_schedule::STATIC: 	omp_set_schedule( omp_sched_static, chunk ); break;
+      case gf_schedule::DYNAMIC: 	omp_set_schedule( omp_sched_dynamic, chunk ); break;
+      case gf_schedule::GUIDED: 	omp_set_schedule( omp_sched_guided, chunk ); break;
+      case gf_schedule::AUTO: 		omp_set_schedule( omp_sched_auto, chunk ); break;
+   }
+#else
+   (void)sched;
+   (void)chunk;
+#endif
+}
+
+// Set the number of threads of the parallel gf loops started from the calling thread
+inline void set_gf_num_threads( const int num_threads )
+{
+#ifdef _OPENMP
+   omp_set_num_threads( num_threads );
+#else
+   (void)num_threads;
+#endif
+}
+
+// Number of threads used by the parallel gf loops
+inline int gf_num_threads()
+{
+#ifdef _OPENMP
+   return omp_get_max_threads();
+#else
+   return 1;
+#endif
+}
+
+/********************* Windowed traversal of out-of-core gf's  ********************/
+
+// Bytes per window in which storages paged in from files ( gf_mmap ) are traversed
+constexpr std::size_t gf_window_bytes = 8 << 20;
+
+namespace gf_detail {
+
+   // Storages paged in from files provide prefetch( first, count ) and release( first, count ) for ranges of elements
+   template< typename gf_t >
+   struct gf_is_streamed
+   {
+      template< typename T > static auto test( const T* g ) -> decltype( g->prefetch( 0, 0 ), g->release( 0, 0 ), std::true_type() );
+      template< typename T > static std::false_type test( ... );
+      static constexpr bool value = decltype( test< gf_t >( nullptr ) )::value;
+   };
+
+   template< typename... G >
+   struct gf_any_streamed : std::false_type {};
+
+   template< typename G1, typename... G >
+   struct gf_any_streamed< G1, G... > : std::integral_constant< bool, gf_is_streamed< G1 >::value || gf_any_streamed< G... >::value > {};
+
+   // Elements [ first, first + count ) clipped to the storage, no-ops for storages in memory
+   template< typename gf_t >
+   inline typename std::enable_if< gf_is_streamed< gf_t >::value >::type gf_prefetch( const gf_t& gf_obj, const std::size_t first, const std::size_t count )
+   {
+      if( first < gf_obj.num_elements() )
+	 gf_obj.prefetch( first, std::min< std::size_t >( count, gf_obj.num_elements() - first ) );
+   }
+
+   template< typename gf_t >
+   inline typename std::enable_if< !gf_is_streamed< gf_t >::value >::type gf_prefetch( const gf_t&, const std::size_t, const std::size_t ) {}
+
+   template< typename gf_t >
+   inline typename std::enable_if< gf_is_streamed< gf_t >::value >::type gf_release( const gf_t& gf_obj, const std::size_t first, const std::size_t count )
+   {
+      if( first < gf_obj.num_elements() )
+	 gf_obj.release( first, std::min< std::size_t >( count, gf_obj.num_elements() - first ) );
+   }
+
+   template< typename gf_t >
+   inline typename std::enable_if< !gf_is_streamed< gf_t >::value >::type gf_release( const gf_t&, const std::size_t, const std::size_t ) {}
+
+   /**
+    * Traversal of n_units units ( rows, rows of tiles ) of unit_len elements of one or more gf's of equal layout,
+    * window_func( begin, end ) processes the units [ begin, end ). If any gf is paged in from a file, the units
+    * are processed in windows of about gf_window_bytes: the next window of every gf is read ahead while the
+    * current one is processed, the processed one is released afterwards. Otherwise all units form one window.
+    */
+   template< typename window_func_t, typename gf_t, typename... G >
+   inline void gf_for_windows( const long n_units, const long unit_len, const window_func_t& window_func, const gf_t& gf_obj, const G&... gf_objs )
+   {
+      if( !gf_any_streamed< gf_t, G... >::value )
+      {
+	 window_func( 0L, n_units );
+	 return;
+      }
+
+      const long units = std::max< long >( gf_window_bytes / ( std::max( unit_len, 1L ) * sizeof( typename gf_t::element ) ), 1 );
+      const std::size_t window = units * unit_len;
+      (void) std::initializer_list< int >{ ( gf_prefetch( gf_obj, 0, window ), 0 ), ( gf_prefetch( gf_objs, 0, window ), 0 )... };
+      for( long begin = 0; begin < n_units; begin += units )
+      {
+	 const long end = std::min( begin + units, n_units );
+	 const std::size_t first = begin * unit_len, next = end * unit_len;
+	 (void) std::initializer_list< int >{ ( gf_prefetch( gf_obj, next, window ), 0 ), ( gf_prefetch( gf_objs, next, window ), 0 )... };
+	 window_func( begin, end );
+	 (void) std::initializer_list< int >{ ( gf_release( gf_obj, first, next - first ), 0 ), ( gf_release( gf_objs, first, next - first ), 0 )... };
+      }
+   }
+
+} // namespace gf_detail
+
+namespace gf_detail {
+
+   // Index of the first element of row r of a row-major gf, the last index is the lower bound of its range
+   template< typename gf_t >
+   inline typename gf_t::idx_t gf_row_first( const gf_t& gf_obj, long r )
+   {
+      constexpr int rank = gf_t::dimensionality;
+      typename gf_t::idx_t idx;
+      idx[rank - 1] = gf_obj.index_bases()[rank - 1];
+      for( int d = rank - 2; d >= 0; --d )
+      {
+	 idx[d] = r % gf_obj.shape()[d] + gf_obj.index_bases()[d];
+	 r /= gf_obj.shape()[d];
+      }
+      return idx;
+   }
+
+   // Generic rank, parallelized over the rows along the last index. The leading indices are decoded once per
+   // row, the last index is incremented along the row
+   template< std::size_t rank >
+   struct init_parallel_impl
+   {
+      template< typename gf_t, typename init_func_t >
+      static void apply( gf_t& gf_obj, const init_func_t& init_func )
+      {
+	 const long row_len = gf_obj.shape()[rank - 1];
+	 const long n_rows = row_len > 0 ? gf_obj.num_elements() / row_len : 0;
+	 auto p = gf_obj.data(); 		// pointer or pointer-like access to the elements
+	 gf_for_windows( n_rows, row_len, [&]( const long r_begin, const long r_end )
+	       {
+#pragma omp parallel for schedule( runtime )
+		  for( long r = r_begin; r < r_end; ++r )
+		  {
+		     typename gf_t::idx_t idx = gf_row_first( gf_obj, r );
+		     for( long j = 0; j < row_len; ++j, ++idx[rank - 1] )
+			p[ r * row_len + j ] = init_func( idx );
+		  }
+	       }, gf_obj );
+      }
+   };
+
+   // One-particle gf, parallelized over the fermionic frequency w
+   template<>
+   struct init_parallel_impl< 1 >
+   {
+      template< typename gf_t, typename init_func_t >
+      static void apply( gf_t& gf_obj, const init_func_t& init_func )
+      {
+	 const int n_w = gf_obj.shape()[0];
+	 const int w_base = gf_obj.index_bases()[0];
+	 auto p = gf_obj.data(); 		// pointer or pointer-like access to the elements
+	 gf_for_windows( n_w, 1, [&]( const long w_begin, const long w_end )
+	       {
+#pragma omp parallel for schedule( runtime )
+		  for( int w = w_begin; w < w_end; ++w )
+		  {
+		     typename gf_t::idx_t idx;
+		     idx[0] = w + w_base;
+		     p[w] = init_func( idx );
+		  }
+	       }, gf_obj );
+      }
+   };
+
+   // Two-particle gf, the ( W, w ) grid is split over the threads, positions follow from the row-major layout
+   template<>
+   struct init_parallel_impl< 2 >
+   {
+      template< typename gf_t, typename init_func_t >
+      static void apply( gf_t& gf_obj, const init_func_t& init_func )
+      {
+	 const int n_W = gf_obj.shape()[0];
+	 const int n_w = gf_obj.shape()[1];
+	 const int W_base = gf_obj.index_bases()[0];
+	 const int w_base = gf_obj.index_bases()[1];
+	 auto p = gf_obj.data(); 		// pointer or pointer-like access to the elements
+	 gf_for_windows( n_W, n_w, [&]( const long W_begin, const long W_end )
+	       {
+#pragma omp parallel for collapse( 2 ) schedule( runtime )
+		  for( int W = W_begin; W < W_end; ++W )
+		     for( int w = 0; w < n_w; ++w )
+		     {
+			typename gf_t::idx_t idx;
+			idx[0] = W + W_base;
+			idx[1] = w + w_base;
+			p[ W * n_w + w ] = init_func( idx );
+		     }
+	       }, gf_obj );
+      }
+   };
+
+   // gf's with a different storage layout provide their own parallel initialization ( e.g. gf_sym )
+   template< typename gf_t, typename init_func_t >
+   auto init_parallel_select( gf_t& gf_obj, const init_func_t& init_func, int ) -> decltype( gf_obj.init_parallel( init_func ) )
+   {
+      gf_obj.init_parallel( init_func );
+   }
+
+   template< typename gf_t, typename init_func_t >
+   void init_parallel_select( gf_t& gf_obj, const init_func_t& init_func, long )
+   {
+      init_parallel_impl< gf_t::dimensionality >::apply( gf_obj, init_func );
+   }
+
+} // namespace gf_detail
+
+/**
+ * Parallel version of gf::init. The frequency indices are distributed over the OpenMP threads
+ * with the schedule set by set_gf_schedule ( or OMP_SCHEDULE ), init_func thus has to be thread-safe.
+ * Assumes the default ( row-major, ascending ) storage order of the gf, unless the gf provides a
+ * member init_parallel. Without OpenMP the initialization is performed serially.
+ */
+template< typename gf_t, typename init_func_t >
+void init_parallel( gf_t& gf_obj, const init_func_t& init_func )
+{
+   gf_detail::init_parallel_select( gf_obj, init_func, 0 );
+}
+
+/********************* Row- and tile-wise initialization of gf's  ********************/
+
+/**
+ * Contiguous row of a gf along its last index. Element row[j] has the index first with the last index
+ * increased by j, such that a row function evaluates the quantities depending on the leading indices
+ * ( e.g. W of the vertex ) once per row and no index is decoded per element.
+ */
+template< typename gf_t >
+struct gf_row_t
+{
+   using idx_t = typename gf_t::idx_t;
+   using ptr_t = decltype( std::declval< gf_t& >().data() );
+
+   idx_t first; 			///< Index of the first element
+   ptr_t data; 			///< Pointer ( or pointer-like access ) to the first element
+   int len; 			///< Number of elements
+
+   auto operator[]( const int j ) const -> decltype( data[j] ) { return data[j]; }
+};
+
+/**
+ * Rectangular tile of a two-particle gf, n_W consecutive rows of n_w elements. Element tile( i, j ) has the
+ * index ( first[0] + i, first[1] + j ), consecutive rows are stride elements apart.
+ */
+template< typename gf_t >
+struct gf_tile_t
+{
+   using idx_t = typename gf_t::idx_t;
+   using ptr_t = decltype( std::declval< gf_t& >().data() );
+
+   idx_t first; 			///< Index of the first element
+   ptr_t data; 			///< Pointer ( or pointer-like access ) to the first element
+   int n_W, n_w; 		///< Extent of the tile
+   long stride; 		///< Elements between consecutive rows
+
+   auto operator()( const int i, const int j ) const -> decltype( data[0] ) { return data[ i * stride + j ]; }
+};
+
+// Default size of the tiles of init_tiles, fits into the L1 cache together with the data read by the tile function
+constexpr std::size_t gf_tile_bytes = 16 * 1024;
+
+namespace gf_detail {
+
+   // Rows of gf's with the default ( row-major, ascending ) storage order, parallelized over the rows
+   template< typename gf_t, typename row_func_t >
+   void init_rows_impl( gf_t& gf_obj, const row_func_t& row_func, long )
+   {
+      constexpr int rank = gf_t::dimensionality;
+      const long row_len = gf_obj.shape()[rank - 1];
+      const long n_rows = row_len > 0 ? gf_obj.num_elements() / row_len : 0;
+      auto p = gf_obj.data();
+      gf_for_windows( n_rows, row_len, [&]( const long r_begin, const long r_end )
+	    {
+#pragma omp parallel for schedule( runtime )
+	       for( long r = r_begin; r < r_end; ++r )
+		  row_func( gf_row_t< gf_t >{ gf_row_first( gf_obj, r ), p + r * row_len, int( row_len ) } );
+	    }, gf_obj );
+   }
+
+   // gf's with a different storage layout ( gf_sym, gf_grid ) are initialized element by element through their
+   // init_parallel, each element is passed as a row of length one
+   template< typename gf_t, typename row_func_t >
+   auto init_rows_impl( gf_t& gf_obj, const row_func_t& row_func, int ) -> decltype( gf_obj.init_parallel( std::declval< typename gf_t::value_t( * )( const typename gf_t::idx_t& ) >() ) )
+   {
+      using value_t = typename gf_t::value_t;
+      gf_obj.init_parallel( [&row_func]( const typename gf_t::idx_t& idx )->value_t
+	    {
+	       value_t val( 0.0 );
+	       row_func( gf_row_t< gf_t >{ idx, &val, 1 } );
+	       return val;
+	    } );
+   }
+
+   template< typename gf_t, typename tile_func_t >
+   void init_tiles_impl( gf_t& gf_obj, const tile_func_t& tile_func, const std::size_t tile_bytes, long )
+   {
+      const int n_W = gf_obj.shape()[0];
+      const int n_w = gf_obj.shape()[1];
+      const int elems = std::max< std::size_t >( tile_bytes / sizeof( typename gf_t::value_t ), 1 );
+      const int t_w = std::max( std::min( n_w, elems ), 1 );
+      const int t_W = std::max( elems / t_w, 1 );
+      const int n_tW = ( n_W + t_W - 1 ) / t_W;
+      const int n_tw = ( n_w + t_w - 1 ) / t_w;
+      auto p = gf_obj.data();
+      // Windows of whole rows of tiles
+      gf_for_windows( n_tW, long( t_W ) * n_w, [&]( const long tW_begin, const long tW_end )
+	    {
+#pragma omp parallel for collapse( 2 ) schedule( runtime )
+	       for( int tW = tW_begin; tW < tW_end; ++tW )
+		  for( int tw = 0; tw < n_tw; ++tw )
+		  {
+		     const int W = tW * t_W, w = tw * t_w;
+		     typename gf_t::idx_t first;
+		     first[0] = W + gf_obj.index_bases()[0];
+		     first[1] = w + gf_obj.index_bases()[1];
+		     tile_func( gf_tile_t< gf_t >{ first, p + long( W ) * n_w + w, std::min( t_W, n_W - W ), std::min( t_w, n_w - w ), n_w } );
+		  }
+	    }, gf_obj );
+   }
+
+   template< typename gf_t, typename tile_func_t >
+   auto init_tiles_impl( gf_t& gf_obj, const tile_func_t& tile_func, const std::size_t, int ) -> decltype( gf_obj.init_parallel( std::declval< typename gf_t::value_t( * )( const typename gf_t::idx_t& ) >() ) )
+   {
+      using value_t = typename gf_t::value_t;
+      gf_obj.init_parallel( [&tile_func]( const typename gf_t::idx_t& idx )->value_t
+	    {
+	       value_t val( 0.0 );
+	       tile_func( gf_tile_t< gf_t >{ idx, &val, 1, 1, 1 } );
+	       return val;
+	    } );
+   }
+
+} // namespace gf_detail
+
+/**
+ * Initialization of a gf row by row, row_func( const gf_row_t< gf_t >& row ) has to set all elements of the
+ * row. The rows are distributed over the OpenMP threads like init_parallel, row_func thus has to be
+ * thread-safe. gf's with their own storage layout ( gf_sym, gf_grid ) pass every stored element as a row of
+ * length one.
+ */
+template< typename gf_t, typename row_func_t >
+void init_rows( gf_t& gf_obj, const row_func_t& row_func )
+{
+   gf_detail::init_rows_impl( gf_obj, row_func, 0 );
+}
+
+/**
+ * Initialization of a two-particle gf tile by tile, tile_func( const gf_tile_t< gf_t >& tile ) has to set all
+ * elements of the tile. The tiles hold about tile_bytes, full rows if they fit, such that the working set of
+ * a tile stays in the cache. Parallelization and the fallback for other storage layouts as for init_rows.
+ */
+template< typename gf_t, typename tile_func_t >
+void init_tiles( gf_t& gf_obj, const tile_func_t& tile_func, const std::size_t tile_bytes = gf_tile_bytes )
+{
+   static_assert( gf_t::dimensionality == 2, "init_tiles requires a two-particle gf" );
+   gf_detail::init_tiles_impl( gf_obj, tile_func, tile_bytes, 0 );
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+
+#include <work_stealing.h>
+
+/********************* Parareal integration, parallel in the flow parameter  ********************/
+
+// Outcome of a Parareal integration
+struct parareal_stats_t
+{
+   int iterations = 0; 			///< Parareal iterations, each with one concurrent round of fine integrations
+   double correction = 0.0; 		///< Maximum norm of the last correction of the slice boundaries
+   bool converged = false; 		///< Correction below the tolerance, otherwise the iterations were exhausted
+};
+
+/**
+ * Parareal integration of x from t0 to t1 on slices equal time slices. The coarse propagator predicts the
+ * states at the slice boundaries sequentially, the fine propagator integrates all slices concurrently from
+ * the predicted states ( work_stealing_for on num_workers threads ). The iteration
+ *
+ *   U[n+1] = G( U[n] ) + F( U_old[n] ) - G( U_old[n] )
+ *
+ * corrects the boundaries until the maximum norm of the correction is below eps_abs + eps_rel * | U |.
+ * After k iterations the first k slices agree with the sequential fine integration, such that at most
+ * slices iterations are done and only the unconverged slices are integrated again.
+ *
+ *   coarse( x, ta, tb ) 		propagates x from ta to tb, cheap ( low order, few steps )
+ *   fine( x, ta, tb, worker ) 		propagates x from ta to tb accurately, worker identifies the thread
+ *
+ * State requires the compound operations and the norm of the arithmetic tuples. Holds 3 * slices + 3 states:
+ * the boundaries U ( slices + 1 ), the fine and coarse results F and G ( slices each ) and two temporaries.
+ */
+template< typename State, typename Coarse, typename Fine >
+parareal_stats_t parareal( const Coarse& coarse, const Fine& fine, State& x, const double t0, const double t1, const int slices,
+      const int num_workers, const double eps_abs, const double eps_rel )
+{
+   using namespace ReaK;
+   parareal_stats_t stats;
+   if( !( t0 < t1 ) ) 	// Nothing to integrate, e.g. after a restart at the final scale
+   {
+      stats.converged = true;
+      return stats;
+   }
+
+   const int S = std::max( slices, 1 );
+   std::vector< double > t( S + 1 );
+   for( int n = 0; n <= S; ++n )
+      t[n] = n < S ? t0 + ( t1 - t0 ) * n / S : t1;
+
+   // Boundaries U, fine and coarse propagation of the previous boundaries F and G
+   std::vector< State > U( S + 1 ), F( S ), G( S );
+   U[0] = x;
+   for( int n = 0; n < S; ++n )
+   {
+      G[n] = U[n];
+      coarse( G[n], t[n], t[n + 1] );
+      U[n + 1] = G[n];
+   }
+
+   State g, next;
+   for( int k = 0; k < S && !stats.converged; ++k )
+   {
+      work_stealing_for( S - k, std::min( num_workers, S - k ), [&]( const std::size_t i, const int worker )
+	    {
+	       const int n = k + i;
+	       F[n] = U[n];
+	       fine( F[n], t[n], t[n + 1], worker );
+	    } );
+
+      // Sequential correction, U[k] is final, hence G( U[k] ) = G[k] and U[k+1] = F[k]
+      double corr = 0.0, scale = 0.0;
+      for( int n = k; n < S; ++n )
+      {
+	 g = U[n];
+	 if( n > k )
+	    coarse( g, t[n], t[n + 1] );
+	 else
+	    g = G[n];
+	 next = g;
+	 next += F[n];
+	 next -= G[n];
+	 U[n + 1] -= next; 	// The correction, by compound operations which all storages provide
+	 corr = std::max( corr, norm( U[n + 1] ) );
+	 scale = std::max( scale, norm( next ) );
+	 U[n + 1] = next;
+	 G[n] = g;
+      }
+      ++stats.iterations;
+      stats.correction = corr;
+      stats.converged = corr <= eps_abs + eps_rel * scale || k + 1 == S;
+   }
+
+   x = U[S];
+   return stats;
+}
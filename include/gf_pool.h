@@ -0,0 +1,192 @@
+#pragma once
+
+#include <new>
+#include <mutex>
+#include <vector>
+#include <limits>
+#include <cstdlib>
+#include <cstddef>
+#include <ostream>
+#include <utility>
+#include <algorithm>
+#include <unordered_map>
+
+/********************* Pool for the storage of gf's  ********************/
+
+// Statistics of the gf_pool
+struct gf_pool_stats_t
+{
+   std::size_t requests = 0; 		///< Number of buffer requests
+   std::size_t hits = 0; 		///< Requests served by a recycled buffer
+   std::size_t bytes_in_use = 0; 	///< Bytes currently handed out
+   std::size_t peak_bytes = 0; 		///< Maximum of bytes_in_use
+   std::size_t bytes_cached = 0; 	///< Bytes kept in the free lists
+
+   double hit_rate() const { return requests > 0 ? double( hits ) / requests : 0.0; }
+};
+
+inline std::ostream& operator<<( std::ostream& os, const gf_pool_stats_t& stats )
+{
+   return os << " requests " << stats.requests << " hits " << stats.hits << " ( " << 100.0 * stats.hit_rate() << " % )"
+      << " in use " << stats.bytes_in_use << " B peak " << stats.peak_bytes << " B cached " << stats.bytes_cached << " B";
+}
+
+/**
+ * Process wide pool of cache line aligned buffers. Released buffers are kept in a free list per size
+ * and handed out again on the next request of the same size. Since all gf's of a kind share their
+ * extents, the temporaries of the steppers ( stage states, error states, copies ) are recycled instead
+ * of going through malloc / free and touching fresh pages every time. At most max_cached bytes are kept
+ * in the free lists ( default_max_cached unless set ), further released buffers are freed. Access is thread-safe.
+ */
+class gf_pool
+{
+   public:
+      static constexpr std::size_t alignment = 64; 	///< Cache line, sufficient for AVX-512
+      static constexpr std::size_t default_max_cached = std::size_t( 256 ) << 20; 	///< Bytes kept in the free lists by default
+
+      static gf_pool& instance()
+      {
+	 static gf_pool pool;
+	 return pool;
+      }
+
+      void* acquire( std::size_t bytes )
+      {
+	 bytes = round_up( bytes );
+	 std::lock_guard< std::mutex > lock( mutex_ );
+	 ++stats_.requests;
+	 stats_.bytes_in_use += bytes;
+	 stats_.peak_bytes = std::max( stats_.peak_bytes, stats_.bytes_in_use );
+
+	 auto it = free_.find( bytes );
+	 if( it != free_.end() && !it->second.empty() )
+	 {
+	    void* p = it->second.back();
+	    it->second.pop_back();
+	    ++stats_.hits;
+	    stats_.bytes_cached -= bytes;
+	    return p;
+	 }
+
+	 void* p = nullptr;
+	 if( posix_memalign( &p, alignment, bytes ) != 0 )
+	 {
+	    stats_.bytes_in_use -= bytes;
+	    throw std::bad_alloc();
+	 }
+	 return p;
+      }
+
+      // Return a buffer obtained from acquire( bytes ) to the pool, it is freed if the cache is full
+      void release( void* p, std::size_t bytes )
+      {
+	 if( p == nullptr )
+	    return;
+	 bytes = round_up( bytes );
+	 std::lock_guard< std::mutex > lock( mutex_ );
+	 stats_.bytes_in_use -= bytes;
+	 if( stats_.bytes_cached + bytes > max_cached_ )
+	 {
+	    std::free( p );
+	    return;
+	 }
+	 free_[bytes].push_back( p );
+	 stats_.bytes_cached += bytes;
+      }
+
+      // Free all cached buffers, buffers in use are unaffected
+      void trim()
+      {
+	 std::lock_guard< std::mutex > lock( mutex_ );
+	 trim_locked();
+      }
+
+      // Upper bound for the bytes kept in the free lists
+      void set_max_cached_bytes( const std::size_t max_cached )
+      {
+	 std::lock_guard< std::mutex > lock( mutex_ );
+	 max_cached_ = max_cached;
+	 if( stats_.bytes_cached > max_cached_ )
+	    trim_locked();
+      }
+
+      gf_pool_stats_t stats() const
+      {
+	 std::lock_guard< std::mutex > lock( mutex_ );
+	 return stats_;
+      }
+
+      void reset_stats()
+      {
+	 std::lock_guard< std::mutex > lock( mutex_ );
+	 stats_.requests = stats_.hits = 0;
+	 stats_.peak_bytes = stats_.bytes_in_use;
+      }
+
+      ~gf_pool() { trim(); }
+
+      gf_pool( const gf_pool& ) = delete;
+      gf_pool& operator=( const gf_pool& ) = delete;
+
+   private:
+      gf_pool() = default;
+
+      void trim_locked()
+      {
+	 for( auto& bucket : free_ )
+	    for( void* p : bucket.second )
+	       std::free( p );
+	 free_.clear();
+	 stats_.bytes_cached = 0;
+      }
+
+      static std::size_t round_up( const std::size_t bytes )
+      {
+	 return ( std::max< std::size_t >( bytes, 1 ) + alignment - 1 ) / alignment * alignment;
+      }
+
+      mutable std::mutex mutex_;
+      std::unordered_map< std::size_t, std::vector< void* > > free_;
+      gf_pool_stats_t stats_;
+      std::size_t max_cached_ = default_max_cached;
+};
+
+inline gf_pool_stats_t gf_pool_stats() { return gf_pool::instance().stats(); }
+
+/**
+ * Standard allocator drawing from the gf_pool, e.g. as the Allocator argument of boost::multi_array
+ * or std::vector for buffers that are repeatedly created with the same size.
+ */
+template< typename T >
+struct gf_pool_allocator
+{
+   using value_type = T;
+   using pointer = T*;
+   using const_pointer = const T*;
+   using reference = T&;
+   using const_reference = const T&;
+   using size_type = std::size_t;
+   using difference_type = std::ptrdiff_t;
+
+   template< typename U >
+   struct rebind { using other = gf_pool_allocator< U >; };
+
+   gf_pool_allocator() = default;
+   template< typename U >
+   gf_pool_allocator( const gf_pool_allocator< U >& ) {}
+
+   T* allocate( const std::size_t n, const void* = nullptr ) { return static_cast< T* >( gf_pool::instance().acquire( n * sizeof( T ) ) ); }
+   void deallocate( T* p, const std::size_t n ) { gf_pool::instance().release( p, n * sizeof( T ) ); }
+
+   std::size_t max_size() const { return std::numeric_limits< std::size_t >::max() / sizeof( T ); }
+
+   template< typename U, typename... Args >
+   void construct( U* p, Args&&... args ) { ::new( static_cast< void* >( p ) ) U( std::forward< Args >( args )... ); }
+   template< typename U >
+   void destroy( U* p ) { p->~U(); }
+};
+
+template< typename T, typename U >
+inline bool operator==( const gf_pool_allocator< T >&, const gf_pool_allocator< U >& ) { return true; }
+template< typename T, typename U >
+inline bool operator!=( const gf_pool_allocator< T >&, const gf_pool_allocator< U >& ) { return false; }
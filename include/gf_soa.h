@@ -0,0 +1,655 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <memory>
+#include <new>
+#include <cstddef>
+#include <complex>
+#include <ostream>
+#include <algorithm>
+#include <functional>
+
+#include <boost/multi_array.hpp>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include <gf.h>
+#include <gf_algebra.h>
+#include <gf_pool.h>
+
+/********************* Split real/imaginary (SoA) storage for complex gf's  ********************/
+
+namespace soa {
+
+   /*****************************************************************************************
+     SIMD primitives, AVX-512 or AVX2 depending on the target, scalar remainder loops otherwise
+    *****************************************************************************************/
+
+#if defined(__AVX512F__)
+#define GF_SOA_SIMD
+   using vec_t = __m512d;
+   constexpr std::size_t vec_len = 8;
+
+   inline vec_t vload( const double* p ) { return _mm512_loadu_pd( p ); }
+   inline void vstore( double* p, vec_t a ) { _mm512_storeu_pd( p, a ); }
+   inline vec_t vset1( double a ) { return _mm512_set1_pd( a ); }
+   inline vec_t vadd( vec_t a, vec_t b ) { return _mm512_add_pd( a, b ); }
+   inline vec_t vsub( vec_t a, vec_t b ) { return _mm512_sub_pd( a, b ); }
+   inline vec_t vmul( vec_t a, vec_t b ) { return _mm512_mul_pd( a, b ); }
+   inline vec_t vdiv( vec_t a, vec_t b ) { return _mm512_div_pd( a, b ); }
+   inline vec_t vfmadd( vec_t a, vec_t b, vec_t c ) { return _mm512_fmadd_pd( a, b, c ); } 	///< a * b + c
+   inline vec_t vfmsub( vec_t a, vec_t b, vec_t c ) { return _mm512_fmsub_pd( a, b, c ); } 	///< a * b - c
+   inline vec_t vsqrt( vec_t a ) { return _mm512_sqrt_pd( a ); }
+   inline vec_t vmax( vec_t a, vec_t b ) { return _mm512_max_pd( a, b ); }
+   inline double hmax( vec_t a ) { return _mm512_reduce_max_pd( a ); }
+   inline double hsum( vec_t a ) { return _mm512_reduce_add_pd( a ); }
+#elif defined(__AVX2__)
+#define GF_SOA_SIMD
+   using vec_t = __m256d;
+   constexpr std::size_t vec_len = 4;
+
+   inline vec_t vload( const double* p ) { return _mm256_loadu_pd( p ); }
+   inline void vstore( double* p, vec_t a ) { _mm256_storeu_pd( p, a ); }
+   inline vec_t vset1( double a ) { return _mm256_set1_pd( a ); }
+   inline vec_t vadd( vec_t a, vec_t b ) { return _mm256_add_pd( a, b ); }
+   inline vec_t vsub( vec_t a, vec_t b ) { return _mm256_sub_pd( a, b ); }
+   inline vec_t vmul( vec_t a, vec_t b ) { return _mm256_mul_pd( a, b ); }
+   inline vec_t vdiv( vec_t a, vec_t b ) { return _mm256_div_pd( a, b ); }
+#ifdef __FMA__
+   inline vec_t vfmadd( vec_t a, vec_t b, vec_t c ) { return _mm256_fmadd_pd( a, b, c ); }
+   inline vec_t vfmsub( vec_t a, vec_t b, vec_t c ) { return _mm256_fmsub_pd( a, b, c ); }
+#else
+   inline vec_t vfmadd( vec_t a, vec_t b, vec_t c ) { return _mm256_add_pd( _mm256_mul_pd( a, b ), c ); }
+   inline vec_t vfmsub( vec_t a, vec_t b, vec_t c ) { return _mm256_sub_pd( _mm256_mul_pd( a, b ), c ); }
+#endif
+   inline vec_t vsqrt( vec_t a ) { return _mm256_sqrt_pd( a ); }
+   inline vec_t vmax( vec_t a, vec_t b ) { return _mm256_max_pd( a, b ); }
+   inline double hmax( vec_t a )
+   {
+      __m128d lo = _mm_max_pd( _mm256_castpd256_pd128( a ), _mm256_extractf128_pd( a, 1 ) );
+      return _mm_cvtsd_f64( _mm_max_sd( lo, _mm_unpackhi_pd( lo, lo ) ) );
+   }
+   inline double hsum( vec_t a )
+   {
+      __m128d lo = _mm_add_pd( _mm256_castpd256_pd128( a ), _mm256_extractf128_pd( a, 1 ) );
+      return _mm_cvtsd_f64( _mm_add_sd( lo, _mm_unpackhi_pd( lo, lo ) ) );
+   }
+#endif
+
+   /*****************************************************************************************
+     Kernels on real arrays of length n, used for the real and imaginary parts
+    *****************************************************************************************/
+
+   // dst = sum_k a[k] * src[k], the linear combination of the Runge-Kutta stages
+   template< std::size_t M >
+   inline void scale_sum( const std::size_t n, double* dst, const std::array< double, M >& a, const std::array< const double*, M >& src )
+   {
+      std::size_t i = 0;
+#ifdef GF_SOA_SIMD
+      vec_t va[M];
+      for( std::size_t k = 0; k < M; ++k )
+	 va[k] = vset1( a[k] );
+      for( ; i + vec_len <= n; i += vec_len )
+      {
+	 vec_t acc = vmul( va[0], vload( src[0] + i ) );
+	 for( std::size_t k = 1; k < M; ++k )
+	    acc = vfmadd( va[k], vload( src[k] + i ), acc );
+	 vstore( dst + i, acc );
+      }
+#endif
+      for( ; i < n; ++i )
+      {
+	 double acc = a[0] * src[0][i];
+	 for( std::size_t k = 1; k < M; ++k )
+	    acc += a[k] * src[k][i];
+	 dst[i] = acc;
+      }
+   }
+
+   // y += a * x
+   inline void axpy( const std::size_t n, const double a, const double* x, double* y )
+   {
+      std::size_t i = 0;
+#ifdef GF_SOA_SIMD
+      const vec_t va = vset1( a );
+      for( ; i + vec_len <= n; i += vec_len )
+	 vstore( y + i, vfmadd( va, vload( x + i ), vload( y + i ) ) );
+#endif
+      for( ; i < n; ++i )
+	 y[i] += a * x[i];
+   }
+
+   // x *= a
+   inline void scale( const std::size_t n, const double a, double* x )
+   {
+      std::size_t i = 0;
+#ifdef GF_SOA_SIMD
+      const vec_t va = vset1( a );
+      for( ; i + vec_len <= n; i += vec_len )
+	 vstore( x + i, vmul( va, vload( x + i ) ) );
+#endif
+      for( ; i < n; ++i )
+	 x[i] *= a;
+   }
+
+   // out = a * b for complex numbers in split storage, out may alias a or b
+   inline void cmul( const std::size_t n, const double* a_re, const double* a_im, const double* b_re, const double* b_im, double* out_re, double* out_im )
+   {
+      std::size_t i = 0;
+#ifdef GF_SOA_SIMD
+      for( ; i + vec_len <= n; i += vec_len )
+      {
+	 const vec_t ar = vload( a_re + i ), ai = vload( a_im + i ), br = vload( b_re + i ), bi = vload( b_im + i );
+	 vstore( out_re + i, vfmsub( ar, br, vmul( ai, bi ) ) );
+	 vstore( out_im + i, vfmadd( ar, bi, vmul( ai, br ) ) );
+      }
+#endif
+      for( ; i < n; ++i )
+      {
+	 const double ar = a_re[i], ai = a_im[i], br = b_re[i], bi = b_im[i];
+	 out_re[i] = ar * br - ai * bi;
+	 out_im[i] = ar * bi + ai * br;
+      }
+   }
+
+   // out = | re + i im |
+   inline void abs( const std::size_t n, const double* re, const double* im, double* out )
+   {
+      std::size_t i = 0;
+#ifdef GF_SOA_SIMD
+      for( ; i + vec_len <= n; i += vec_len )
+      {
+	 const vec_t r = vload( re + i ), m = vload( im + i );
+	 vstore( out + i, vsqrt( vfmadd( r, r, vmul( m, m ) ) ) );
+      }
+#endif
+      for( ; i < n; ++i )
+	 out[i] = std::sqrt( re[i] * re[i] + im[i] * im[i] );
+   }
+
+   // max | re + i im |^2, the square root is left to the caller
+   inline double max_abs2( const std::size_t n, const double* re, const double* im )
+   {
+      std::size_t i = 0;
+      double res = 0.0;
+#ifdef GF_SOA_SIMD
+      vec_t vres = vset1( 0.0 );
+      for( ; i + vec_len <= n; i += vec_len )
+      {
+	 const vec_t r = vload( re + i ), m = vload( im + i );
+	 vres = vmax( vres, vfmadd( r, r, vmul( m, m ) ) );
+      }
+      res = hmax( vres );
+#endif
+      for( ; i < n; ++i )
+	 res = std::max( res, re[i] * re[i] + im[i] * im[i] );
+      return res;
+   }
+
+   // sum Re( conj( a ) b ) = a_re b_re + a_im b_im
+   inline double dot( const std::size_t n, const double* a_re, const double* a_im, const double* b_re, const double* b_im )
+   {
+      std::size_t i = 0;
+      double res = 0.0;
+#ifdef GF_SOA_SIMD
+      vec_t vres = vset1( 0.0 );
+      for( ; i + vec_len <= n; i += vec_len )
+	 vres = vfmadd( vload( a_re + i ), vload( b_re + i ), vfmadd( vload( a_im + i ), vload( b_im + i ), vres ) );
+      res = hsum( vres );
+#endif
+      for( ; i < n; ++i )
+	 res += a_re[i] * b_re[i] + a_im[i] * b_im[i];
+      return res;
+   }
+
+   // err = | err | / ( eps_abs + eps_rel * ( a_x * | x | + a_dxdt * | dxdt | ) ), stored as a real number
+   inline void rel_error( const std::size_t n, double* err_re, double* err_im, const double* x_re, const double* x_im, const double* dxdt_re, const double* dxdt_im,
+	 const double eps_abs, const double eps_rel, const double a_x, const double a_dxdt )
+   {
+      std::size_t i = 0;
+#ifdef GF_SOA_SIMD
+      const vec_t v_eps_abs = vset1( eps_abs ), v_rel_x = vset1( eps_rel * a_x ), v_rel_dxdt = vset1( eps_rel * a_dxdt ), zero = vset1( 0.0 );
+      for( ; i + vec_len <= n; i += vec_len )
+      {
+	 const vec_t er = vload( err_re + i ), ei = vload( err_im + i );
+	 const vec_t xr = vload( x_re + i ), xi = vload( x_im + i );
+	 const vec_t dr = vload( dxdt_re + i ), di = vload( dxdt_im + i );
+	 const vec_t denom = vfmadd( v_rel_dxdt, vsqrt( vfmadd( dr, dr, vmul( di, di ) ) ), vfmadd( v_rel_x, vsqrt( vfmadd( xr, xr, vmul( xi, xi ) ) ), v_eps_abs ) );
+	 vstore( err_re + i, vdiv( vsqrt( vfmadd( er, er, vmul( ei, ei ) ) ), denom ) );
+	 vstore( err_im + i, zero );
+      }
+#endif
+      for( ; i < n; ++i )
+      {
+	 const double abs_err = std::sqrt( err_re[i] * err_re[i] + err_im[i] * err_im[i] );
+	 const double abs_x = std::sqrt( x_re[i] * x_re[i] + x_im[i] * x_im[i] );
+	 const double abs_dxdt = std::sqrt( dxdt_re[i] * dxdt_re[i] + dxdt_im[i] * dxdt_im[i] );
+	 err_re[i] = abs_err / ( eps_abs + eps_rel * ( a_x * abs_x + a_dxdt * abs_dxdt ) );
+	 err_im[i] = 0.0;
+      }
+   }
+
+   // max | err | / ( eps_abs + eps_rel * ( a_x * | x | + a_dxdt * | dxdt | ) ), err is only read
+   inline double max_rel_error( const std::size_t n, const double* err_re, const double* err_im, const double* x_re, const double* x_im, const double* dxdt_re, const double* dxdt_im,
+	 const double eps_abs, const double eps_rel, const double a_x, const double a_dxdt )
+   {
+      std::size_t i = 0;
+      double res = 0.0;
+#ifdef GF_SOA_SIMD
+      const vec_t v_eps_abs = vset1( eps_abs ), v_rel_x = vset1( eps_rel * a_x ), v_rel_dxdt = vset1( eps_rel * a_dxdt );
+      vec_t vres = vset1( 0.0 );
+      for( ; i + vec_len <= n; i += vec_len )
+      {
+	 const vec_t er = vload( err_re + i ), ei = vload( err_im + i );
+	 const vec_t xr = vload( x_re + i ), xi = vload( x_im + i );
+	 const vec_t dr = vload( dxdt_re + i ), di = vload( dxdt_im + i );
+	 const vec_t denom = vfmadd( v_rel_dxdt, vsqrt( vfmadd( dr, dr, vmul( di, di ) ) ), vfmadd( v_rel_x, vsqrt( vfmadd( xr, xr, vmul( xi, xi ) ) ), v_eps_abs ) );
+	 vres = vmax( vres, vdiv( vsqrt( vfmadd( er, er, vmul( ei, ei ) ) ), denom ) );
+      }
+      res = hmax( vres );
+#endif
+      for( ; i < n; ++i )
+      {
+	 const double abs_err = std::sqrt( err_re[i] * err_re[i] + err_im[i] * err_im[i] );
+	 const double abs_x = std::sqrt( x_re[i] * x_re[i] + x_im[i] * x_im[i] );
+	 const double abs_dxdt = std::sqrt( dxdt_re[i] * dxdt_re[i] + dxdt_im[i] * dxdt_im[i] );
+	 res = std::max( res, abs_err / ( eps_abs + eps_rel * ( a_x * abs_x + a_dxdt * abs_dxdt ) ) );
+      }
+      return res;
+   }
+
+   /*****************************************************************************************
+     Aligned storage
+    *****************************************************************************************/
+
+   // Buffers are drawn from the gf_pool, such that temporaries of equal extents are recycled
+   struct aligned_deleter
+   {
+      std::size_t n;
+      void operator()( double* p ) const { gf_pool::instance().release( p, n * sizeof( double ) ); }
+   };
+   using aligned_ptr = std::unique_ptr< double[], aligned_deleter >;
+
+   inline aligned_ptr aligned_alloc( const std::size_t n )
+   {
+      return aligned_ptr( static_cast< double* >( gf_pool::instance().acquire( n * sizeof( double ) ) ), aligned_deleter{ n } );
+   }
+
+   // Reference to a complex element in split storage
+   class elem_ref
+   {
+      public:
+	 elem_ref( double& re, double& im ): re_( re ), im_( im ) {}
+	 elem_ref& operator=( const std::complex< double >& val ) { re_ = val.real(); im_ = val.imag(); return *this; }
+	 elem_ref& operator=( const elem_ref& other ) { return *this = std::complex< double >( other ); }
+	 operator std::complex< double >() const { return std::complex< double >( re_, im_ ); }
+      private:
+	 double& re_;
+	 double& im_;
+   };
+
+   inline std::ostream& operator<<( std::ostream& os, const elem_ref& ref ) { return os << std::complex< double >( ref ); }
+
+   // Pointer-like access to the elements, such that generic element loops ( p[i] = val ) also work for split storage
+   class elem_ptr
+   {
+      public:
+	 elem_ptr( double* re, double* im ): re_( re ), im_( im ) {}
+	 elem_ref operator[]( const std::size_t i ) const { return elem_ref( re_[i], im_[i] ); }
+	 elem_ptr operator+( const std::size_t i ) const { return elem_ptr( re_ + i, im_ + i ); }
+      private:
+	 double* re_;
+	 double* im_;
+   };
+
+} // namespace soa
+
+/**
+ * Container for complex gf's of rank R with the real and imaginary parts in separate, 64 byte aligned
+ * arrays. Mirrors the parts of the gf / boost::multi_array interface used in this project ( construction
+ * from boost::extents, shape(), index_bases(), num_elements(), flat element access, init ), while the
+ * arithmetic is performed by the SIMD kernels in namespace soa.
+ */
+template< unsigned R >
+class gf_soa
+{
+   public:
+      static constexpr std::size_t dimensionality = R;
+      using value_t = std::complex< double >;
+      using element = value_t;
+      using idx_t = typename gf< value_t, R >::idx_t;
+      using index = boost::multi_array_types::index;
+      using size_type = boost::multi_array_types::size_type;
+
+      gf_soa( const boost::detail::multi_array::extent_gen< R >& ext ):
+	 num_elements_( 1 )
+   {
+      for( unsigned d = 0; d < R; ++d )
+      {
+	 shape_[d] = ext.ranges_[d].size();
+	 index_bases_[d] = ext.ranges_[d].start();
+	 num_elements_ *= shape_[d];
+      }
+      re_ = soa::aligned_alloc( num_elements_ );
+      im_ = soa::aligned_alloc( num_elements_ );
+      std::fill( re(), re() + num_elements_, 0.0 );
+      std::fill( im(), im() + num_elements_, 0.0 );
+   }
+
+      gf_soa( const gf_soa& other ):
+	 shape_( other.shape_ ), index_bases_( other.index_bases_ ), num_elements_( other.num_elements_ ),
+	 re_( soa::aligned_alloc( other.num_elements_ ) ), im_( soa::aligned_alloc( other.num_elements_ ) )
+   {
+      std::copy( other.re(), other.re() + num_elements_, re() );
+      std::copy( other.im(), other.im() + num_elements_, im() );
+   }
+
+      gf_soa( gf_soa&& other ) = default;
+
+      gf_soa& operator=( const gf_soa& other )
+      {
+	 if( this == &other )
+	    return *this;
+	 if( num_elements_ != other.num_elements_ )
+	 {
+	    re_ = soa::aligned_alloc( other.num_elements_ );
+	    im_ = soa::aligned_alloc( other.num_elements_ );
+	 }
+	 shape_ = other.shape_;
+	 index_bases_ = other.index_bases_;
+	 num_elements_ = other.num_elements_;
+	 std::copy( other.re(), other.re() + num_elements_, re() );
+	 std::copy( other.im(), other.im() + num_elements_, im() );
+	 return *this;
+      }
+
+      gf_soa& operator=( gf_soa&& other ) = default;
+
+      size_type num_elements() const { return num_elements_; }
+      const size_type* shape() const { return shape_.data(); }
+      const index* index_bases() const { return index_bases_.data(); }
+
+      double* re() { return re_.get(); }
+      const double* re() const { return re_.get(); }
+      double* im() { return im_.get(); }
+      const double* im() const { return im_.get(); }
+
+      soa::elem_ptr data() { return soa::elem_ptr( re(), im() ); }
+
+      // Flat element access
+      soa::elem_ref operator()( const int pos ) { return soa::elem_ref( re_[pos], im_[pos] ); }
+      value_t operator()( const int pos ) const { return value_t( re_[pos], im_[pos] ); }
+
+      // Element access by index
+      soa::elem_ref operator()( const idx_t& idx ) { return (*this)( get_pos( idx ) ); }
+      value_t operator()( const idx_t& idx ) const { return (*this)( get_pos( idx ) ); }
+
+      int get_pos( const idx_t& idx ) const
+      {
+	 int pos = 0;
+	 for( unsigned d = 0; d < R; ++d )
+	    pos = pos * shape_[d] + ( idx[d] - index_bases_[d] );
+	 return pos;
+      }
+
+      idx_t get_idx( int pos ) const
+      {
+	 idx_t idx;
+	 for( int d = R - 1; d >= 0; --d )
+	 {
+	    idx[d] = pos % shape_[d] + index_bases_[d];
+	    pos /= shape_[d];
+	 }
+	 return idx;
+      }
+
+      void init( std::function< value_t( const idx_t& idx ) > init_func )
+      {
+	 for( size_type pos = 0; pos < num_elements_; ++pos )
+	    (*this)( pos ) = init_func( get_idx( pos ) );
+      }
+
+      gf_soa& operator+=( const gf_soa& rhs )
+      {
+	 soa::axpy( num_elements_, 1.0, rhs.re(), re() );
+	 soa::axpy( num_elements_, 1.0, rhs.im(), im() );
+	 return *this;
+      }
+
+      gf_soa& operator-=( const gf_soa& rhs )
+      {
+	 soa::axpy( num_elements_, -1.0, rhs.re(), re() );
+	 soa::axpy( num_elements_, -1.0, rhs.im(), im() );
+	 return *this;
+      }
+
+      gf_soa& operator*=( const double rhs )
+      {
+	 soa::scale( num_elements_, rhs, re() );
+	 soa::scale( num_elements_, rhs, im() );
+	 return *this;
+      }
+
+      gf_soa& operator/=( const double rhs ) { return *this *= 1.0 / rhs; }
+
+      // Elementwise complex multiplication
+      gf_soa& operator*=( const gf_soa& rhs )
+      {
+	 soa::cmul( num_elements_, re(), im(), rhs.re(), rhs.im(), re(), im() );
+	 return *this;
+      }
+
+   private:
+      std::array< size_type, R > shape_;
+      std::array< index, R > index_bases_;
+      size_type num_elements_;
+      soa::aligned_ptr re_;
+      soa::aligned_ptr im_;
+};
+
+// Maximum norm
+template< unsigned R >
+double norm( const gf_soa< R >& gf_obj )
+{
+   return std::sqrt( soa::max_abs2( gf_obj.num_elements(), gf_obj.re(), gf_obj.im() ) );
+}
+
+// Elementwise magnitude, stored as real part
+template< unsigned R >
+gf_soa< R > abs( const gf_soa< R >& gf_obj )
+{
+   gf_soa< R > res( gf_obj );
+   soa::abs( res.num_elements(), gf_obj.re(), gf_obj.im(), res.re() );
+   std::fill( res.im(), res.im() + res.num_elements(), 0.0 );
+   return res;
+}
+
+namespace soa_detail {
+
+   using boost::numeric::odeint::default_operations;
+
+   // Real coefficients of the scale_sum operations, such that they act separately on the real and imaginary parts
+   template< class F1 >
+   std::array< double, 1 > coeffs( const default_operations::scale_sum1< F1 >& op )
+   { return {{ double( op.m_alpha1 ) }}; }
+
+   template< class F1, class F2 >
+   std::array< double, 2 > coeffs( const default_operations::scale_sum2< F1, F2 >& op )
+   { return {{ double( op.m_alpha1 ), double( op.m_alpha2 ) }}; }
+
+   template< class F1, class F2, class F3 >
+   std::array< double, 3 > coeffs( const default_operations::scale_sum3< F1, F2, F3 >& op )
+   { return {{ double( op.m_alpha1 ), double( op.m_alpha2 ), double( op.m_alpha3 ) }}; }
+
+   template< class F1, class F2, class F3, class F4 >
+   std::array< double, 4 > coeffs( const default_operations::scale_sum4< F1, F2, F3, F4 >& op )
+   { return {{ double( op.m_alpha1 ), double( op.m_alpha2 ), double( op.m_alpha3 ), double( op.m_alpha4 ) }}; }
+
+   template< class F1, class F2, class F3, class F4, class F5 >
+   std::array< double, 5 > coeffs( const default_operations::scale_sum5< F1, F2, F3, F4, F5 >& op )
+   { return {{ double( op.m_alpha1 ), double( op.m_alpha2 ), double( op.m_alpha3 ), double( op.m_alpha4 ), double( op.m_alpha5 ) }}; }
+
+   template< class F1, class F2, class F3, class F4, class F5, class F6 >
+   std::array< double, 6 > coeffs( const default_operations::scale_sum6< F1, F2, F3, F4, F5, F6 >& op )
+   { return {{ double( op.m_alpha1 ), double( op.m_alpha2 ), double( op.m_alpha3 ), double( op.m_alpha4 ), double( op.m_alpha5 ), double( op.m_alpha6 ) }}; }
+
+   template< class F1, class F2, class F3, class F4, class F5, class F6, class F7 >
+   std::array< double, 7 > coeffs( const default_operations::scale_sum7< F1, F2, F3, F4, F5, F6, F7 >& op )
+   { return {{ double( op.m_alpha1 ), double( op.m_alpha2 ), double( op.m_alpha3 ), double( op.m_alpha4 ), double( op.m_alpha5 ), double( op.m_alpha6 ), double( op.m_alpha7 ) }}; }
+
+   // Linear combination dst = sum_k a_k src_k on one pair of gf_soa's
+   template< typename Op, typename G1, typename... G >
+   inline void apply( const Op& op, G1& dst, const G&... src )
+   {
+      const auto a = coeffs( op );
+      static_assert( sizeof...( G ) == std::tuple_size< decltype( a ) >::value, "scale_sum arity mismatch" );
+      soa::scale_sum( dst.num_elements(), dst.re(), a, {{ src.re()... }} );
+      soa::scale_sum( dst.num_elements(), dst.im(), a, {{ src.im()... }} );
+   }
+
+   template< class Fac, typename G1, typename G2, typename G3 >
+   inline void apply( const gf_operations::rel_error< Fac >& op, G1& err, const G2& x, const G3& dxdt )
+   {
+      soa::rel_error( err.num_elements(), err.re(), err.im(), x.re(), x.im(), dxdt.re(), dxdt.im(), op.m_eps_abs, op.m_eps_rel, op.m_a_x, op.m_a_dxdt );
+   }
+
+   // Recursion over the members of the arithmetic tuples
+   template< std::size_t K, std::size_t Size >
+   struct for_each_impl
+   {
+      template< typename Op, typename... S >
+      static inline void run( const Op& op, S&... s )
+      {
+	 apply( op, std::get< K >( s )... );
+	 for_each_impl< K + 1, Size >::run( op, s... );
+      }
+   };
+
+   template< std::size_t Size >
+   struct for_each_impl< Size, Size >
+   {
+      template< typename Op, typename... S >
+      static inline void run( const Op&, S&... ) {}
+   };
+
+   template< typename Op, typename S1, typename... S >
+   inline void for_each( const Op& op, S1& s1, S&... s )
+   {
+      for_each_impl< 0, ReaK::arithmetic_tuple_size< typename std::remove_const< S1 >::type >::value >::run( op, s1, s... );
+   }
+
+   template< std::size_t K, std::size_t Size >
+   struct max_abs2_impl
+   {
+      template< typename S >
+      static inline double run( const S& s )
+      {
+	 const auto& g = std::get< K >( s );
+	 return std::max( soa::max_abs2( g.num_elements(), g.re(), g.im() ), max_abs2_impl< K + 1, Size >::run( s ) );
+      }
+   };
+
+   template< std::size_t Size >
+   struct max_abs2_impl< Size, Size >
+   {
+      template< typename S >
+      static inline double run( const S& ) { return 0.0; }
+   };
+
+   template< std::size_t K, std::size_t Size >
+   struct inner_prod_impl
+   {
+      template< typename S1, typename S2 >
+      static inline double run( const S1& s1, const S2& s2 )
+      {
+	 const auto& a = std::get< K >( s1 );
+	 const auto& b = std::get< K >( s2 );
+	 return soa::dot( a.num_elements(), a.re(), a.im(), b.re(), b.im() ) + inner_prod_impl< K + 1, Size >::run( s1, s2 );
+      }
+   };
+
+   template< std::size_t Size >
+   struct inner_prod_impl< Size, Size >
+   {
+      template< typename S1, typename S2 >
+      static inline double run( const S1&, const S2& ) { return 0.0; }
+   };
+
+   template< std::size_t K, std::size_t Size >
+   struct max_rel_error_impl
+   {
+      template< typename S1, typename S2, typename S3 >
+      static inline double run( const S1& err, const S2& x, const S3& dxdt, const double eps_abs, const double eps_rel, const double a_x, const double a_dxdt )
+      {
+	 const auto& e = std::get< K >( err );
+	 const auto& g = std::get< K >( x );
+	 const auto& d = std::get< K >( dxdt );
+	 return std::max( soa::max_rel_error( e.num_elements(), e.re(), e.im(), g.re(), g.im(), d.re(), d.im(), eps_abs, eps_rel, a_x, a_dxdt ), 
+	       max_rel_error_impl< K + 1, Size >::run( err, x, dxdt, eps_abs, eps_rel, a_x, a_dxdt ) );
+      }
+   };
+
+   template< std::size_t Size >
+   struct max_rel_error_impl< Size, Size >
+   {
+      template< typename S1, typename S2, typename S3 >
+      static inline double run( const S1&, const S2&, const S3&, const double, const double, const double, const double ) { return 0.0; }
+   };
+
+} // namespace soa_detail
+
+/**
+ * Odeint algebra for arithmetic tuples of gf_soa's, to be combined with gf_operations. The scale_sum
+ * operations of the Runge-Kutta stages have real coefficients and are thus performed by the SIMD
+ * scale_sum kernel separately on the real and imaginary arrays, the relative error, its maximum, the
+ * maximum norm and the inner product by their dedicated kernels. Other operations are not supported.
+ */
+struct soa_algebra
+{
+   template< class S1, class Op >
+   static void for_each1( S1& s1, Op op )
+   { soa_detail::for_each( op, s1 ); }
+
+   template< class S1, class S2, class Op >
+   static void for_each2( S1& s1, S2& s2, Op op )
+   { soa_detail::for_each( op, s1, s2 ); }
+
+   template< class S1, class S2, class S3, class Op >
+   static void for_each3( S1& s1, S2& s2, S3& s3, Op op )
+   { soa_detail::for_each( op, s1, s2, s3 ); }
+
+   template< class S1, class S2, class S3, class S4, class Op >
+   static void for_each4( S1& s1, S2& s2, S3& s3, S4& s4, Op op )
+   { soa_detail::for_each( op, s1, s2, s3, s4 ); }
+
+   template< class S1, class S2, class S3, class S4, class S5, class Op >
+   static void for_each5( S1& s1, S2& s2, S3& s3, S4& s4, S5& s5, Op op )
+   { soa_detail::for_each( op, s1, s2, s3, s4, s5 ); }
+
+   template< class S1, class S2, class S3, class S4, class S5, class S6, class Op >
+   static void for_each6( S1& s1, S2& s2, S3& s3, S4& s4, S5& s5, S6& s6, Op op )
+   { soa_detail::for_each( op, s1, s2, s3, s4, s5, s6 ); }
+
+   template< class S1, class S2, class S3, class S4, class S5, class S6, class S7, class Op >
+   static void for_each7( S1& s1, S2& s2, S3& s3, S4& s4, S5& s5, S6& s6, S7& s7, Op op )
+   { soa_detail::for_each( op, s1, s2, s3, s4, s5, s6, s7 ); }
+
+   template< class S1, class S2, class S3, class S4, class S5, class S6, class S7, class S8, class Op >
+   static void for_each8( S1& s1, S2& s2, S3& s3, S4& s4, S5& s5, S6& s6, S7& s7, S8& s8, Op op )
+   { soa_detail::for_each( op, s1, s2, s3, s4, s5, s6, s7, s8 ); }
+
+   template< class S >
+   static double norm_inf( const S& s )
+   { return std::sqrt( soa_detail::max_abs2_impl< 0, ReaK::arithmetic_tuple_size< S >::value >::run( s ) ); }
+
+   template< class S1, class S2, class S3 >
+   static double max_rel_error( const S1& err, const S2& x, const S3& dxdt, const double eps_abs, const double eps_rel, const double a_x, const double a_dxdt )
+   { return soa_detail::max_rel_error_impl< 0, ReaK::arithmetic_tuple_size< S1 >::value >::run( err, x, dxdt, eps_abs, eps_rel, a_x, a_dxdt ); }
+
+   template< class S1, class S2 >
+   static double inner_prod( const S1& s1, const S2& s2 )
+   { return soa_detail::inner_prod_impl< 0, ReaK::arithmetic_tuple_size< S1 >::value >::run( s1, s2 ); }
+};
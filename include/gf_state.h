@@ -0,0 +1,250 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <complex>
+#include <utility>
+
+#include <boost/numeric/odeint.hpp>
+
+#include <arithmetic_tuple.h>
+#include <gf.h>
+#include <gf_algebra.h>
+#include <gf_parallel.h>
+#include <gf_mpi.h>
+#include <gf_soa.h>
+#include <gf_pool.h>
+#include <gf_sym.h>
+#include <gf_grid.h>
+#include <gf_mmap.h>
+#include <gf_instr.h>
+#include <gf_implicit.h>
+#include <gf_checkpoint.h>
+
+/********************* State of the flow and its steppers  ********************/
+
+// Shared by the flow ( src/ode.cpp ) and the benchmarks ( bench/bench.cpp ), which define the globals below.
+// The storage of the gf's and the algebra follow from the build flags GF_FLOAT, GF_SOA, GF_SYM, GF_GRID and GF_MMAP
+
+using dcomplex = std::complex< double >;
+
+extern int N; 		///< Number of Matsubara frequencies, set before any gf is created
+extern int N_eff; 		///< Effective cutoff of the compressed frequency grids ( GF_GRID )
+extern int N_sparse; 		///< Sparse frequencies beyond the dense window of N frequencies ( GF_GRID )
+
+// Objects depending on the number of frequencies are built once per N, which changes between the levels of a
+// multilevel flow. Entries are never removed, such that references stay valid
+template< typename T, typename Make >
+const T& per_N( const Make& make )
+{
+   static std::mutex mutex;
+   static std::map< int, T > cache;
+   std::lock_guard< std::mutex > lock( mutex );
+   auto it = cache.find( N );
+   if( it == cache.end() )
+      it = cache.emplace( N, make() ).first;
+   return it->second;
+}
+
+// Elements of the vertex, single precision halves the memory and the memory traffic of Gam ( GF_FLOAT ). Sig
+// stays double, the algebra accumulates the stages and norms in double and the error checker respects the
+// precision floor of the state, see gf_algebra.h
+#ifdef GF_FLOAT
+#if defined(GF_SOA)
+#error "GF_FLOAT can not be combined with GF_SOA"
+#endif
+using Gam_value_t = std::complex< float >;
+#else
+using Gam_value_t = dcomplex;
+#endif
+
+// Storage of the gf's: interleaved complex in gf with the elements drawn from the gf_pool or split real/imaginary parts with SIMD kernels (gf_soa)
+#ifdef GF_GRID
+#if defined(GF_SOA) || defined(GF_SYM) || defined(MPI_PARALLEL)
+#error "GF_GRID can not be combined with GF_SOA, GF_SYM or MPI_PARALLEL"
+#endif
+// Dense window of N frequencies and N_sparse logarithmic frequencies up to N_eff, see gf_grid.h
+template< unsigned rank, typename value_t = dcomplex > using gf_storage_t = gf_grid< value_t, rank >;
+using state_algebra_t = gf_algebra;
+
+inline const std::shared_ptr< const freq_grid_t >& fgrid_N()
+{
+   return per_N< std::shared_ptr< const freq_grid_t > >( [](){ return fgrid( N, N_eff, N_sparse ); } );
+}
+
+inline const std::shared_ptr< const freq_grid_t >& bgrid_N()
+{
+   return per_N< std::shared_ptr< const freq_grid_t > >( [](){ return bgrid( N, N_eff, N_sparse ); } );
+}
+#elif defined(GF_SOA)
+template< unsigned rank, typename value_t = dcomplex > using gf_storage_t = gf_soa< rank >;
+using state_algebra_t = soa_algebra;
+#else
+template< unsigned rank, typename value_t = dcomplex > using gf_storage_t = gf< value_t, rank, gf_pool_allocator< value_t > >;
+using state_algebra_t = gf_algebra;
+#endif
+
+#define INSERT_COPY_AND_ASSIGN(X) 					\
+X( const X & obj ):    							\
+   base_t( obj )							\
+{}       								\
+X( X && obj ):								\
+   base_t( std::move(obj) )						\
+{}      								\
+X & operator=( const X & obj )						\
+{									\
+   base_t::operator=( obj ); 						\
+   return *this; 							\
+} 									\
+X & operator=( X && obj )						\
+{									\
+   base_t::operator=( std::move( obj ) ); 				\
+   return *this; 							\
+}
+
+enum class I1P{ w };
+class gf_1p_t : public gf_storage_t< 1 > 		///< Container type for one-particle correlation function
+{
+   public:
+      using base_t = gf_storage_t< 1 >;
+
+      gf_1p_t():
+#ifdef GF_GRID
+	 base_t( base_t::grids_t{{ fgrid_N() }} )
+#else
+	 base_t( boost::extents[ffreq(N)] )
+#endif
+   {}
+      INSERT_COPY_AND_ASSIGN(gf_1p_t)
+};
+using idx_1p_t = gf_1p_t::idx_t;
+
+// Partition of the bosonic frequencies over the MPI ranks, full range without MPI_PARALLEL
+inline const slab_t& W_slab()
+{
+   return per_N< slab_t >( [](){ return slab_t( bfreq(N) ); } );
+}
+
+enum class I2P{ W, w };
+
+// Symmetry-reduced storage of the vertex, only the irreducible elements are stored and computed
+#ifdef GF_SYM
+#if defined(GF_SOA) || defined(MPI_PARALLEL) || defined(GF_MMAP)
+#error "GF_SYM can not be combined with GF_SOA, MPI_PARALLEL or GF_MMAP"
+#endif
+template< typename value_t > using gf_2p_storage_t = gf_sym< value_t, 2 >;
+
+// Gam( -W, -w-1 ) = conj( Gam( W, w ) )
+inline std::shared_ptr< const gf_sym_table< 2 > > Gam_sym_table()
+{
+   using table_t = gf_sym_table< 2 >;
+   return per_N< std::shared_ptr< const table_t > >( [](){ return std::make_shared< const table_t >( boost::extents[bfreq(N)][ffreq(N)],
+	    std::vector< table_t::sym_op_t >{ []( table_t::idx_t& idx ){ idx( I2P::W ) = -idx( I2P::W ); idx( I2P::w ) = -idx( I2P::w ) - 1; return true; } } ); } );
+}
+#elif defined(GF_MMAP)
+#if defined(GF_SOA) || defined(GF_GRID)
+#error "GF_MMAP can not be combined with GF_SOA or GF_GRID"
+#endif
+// Only the vertex is stored out of core in memory-mapped files, Sig stays on the heap, see gf_mmap.h
+template< typename value_t > using gf_2p_storage_t = gf_mmap< value_t, 2 >;
+#else
+template< typename value_t > using gf_2p_storage_t = gf_storage_t< 2, value_t >;
+#endif
+
+// Container type for two-particle correlation functions with elements of type value_t, distributed along W
+template< typename value_t >
+class gf_2p_tmpl_t : public gf_2p_storage_t< value_t >
+{
+   public:
+      using base_t = gf_2p_storage_t< value_t >;
+
+      gf_2p_tmpl_t():
+#if defined(GF_SYM)
+	 base_t( Gam_sym_table() )
+#elif defined(GF_GRID)
+	 base_t( typename base_t::grids_t{{ bgrid_N(), fgrid_N() }} )
+#else
+	 base_t( boost::extents[W_slab().local_range()][ffreq(N)] )
+#endif
+   {}
+      INSERT_COPY_AND_ASSIGN(gf_2p_tmpl_t)
+};
+
+using gf_2p_t = gf_2p_tmpl_t< Gam_value_t >; 	///< Vertex of the flow
+using idx_2p_t = gf_2p_t::idx_t;
+using row_2p_t = gf_row_t< gf_2p_t >; 		///< Row along w at fixed W, see init_rows
+using tile_2p_t = gf_tile_t< gf_2p_t >; 	///< Block of W and w, see init_tiles
+
+// The state type for the Ode solver, tuple of gf's with arithmetic operations, for a vertex of type Gam_t_
+template< typename Gam_t_ >
+class state_tmpl_t: public ReaK::arithmetic_tuple< gf_1p_t, Gam_t_ >
+{
+   public:
+      using base_t = ReaK::arithmetic_tuple< gf_1p_t, Gam_t_ >;
+      using Sig_t = gf_1p_t;
+      using Gam_t = Gam_t_;
+
+      inline Sig_t& Sig() { return( std::get<0>( *this ) ); }
+      inline const Sig_t& Sig() const { return( std::get<0>( *this ) ); }
+
+      inline Gam_t& Gam() { return( std::get<1>( *this ) ); }
+      inline const Gam_t& Gam() const { return( std::get<1>( *this ) ); }
+
+      state_tmpl_t():
+	 base_t()
+   {}
+      INSERT_COPY_AND_ASSIGN(state_tmpl_t)
+
+      // Evaluation of lazy arithmetic expressions directly into the state
+      template< typename Expr >
+      state_tmpl_t( const ReaK::arithmetic_tuple_expr< Expr >& expr ):
+	 base_t( expr )
+   {}
+      template< typename Expr >
+      state_tmpl_t& operator=( const ReaK::arithmetic_tuple_expr< Expr >& expr )
+      {
+	 base_t::operator=( expr );
+	 return *this;
+      }
+};
+
+using state_t = state_tmpl_t< gf_2p_t >; 	///< State of the flow
+
+// Norm of the states, needed for adaptive stepping routines, maximum over all MPI ranks
+namespace boost { namespace numeric { namespace odeint {
+   template< typename Gam_t >
+      struct vector_space_norm_inf< state_tmpl_t< Gam_t > >
+      {
+	 typedef double result_type;
+	 double operator()( const state_tmpl_t< Gam_t > &p ) const
+	 {
+	    using namespace std;
+	    return mpi_max( norm( p ) );
+	 }
+      };
+}}}
+
+// Type of adaptive stepper, the algebra traverses the storage of Sig and Gam once per stage
+// The norm of mpi_algebra is reduced over all ranks, keeping the step sizes consistent, instr_algebra times the operations
+typedef mpi_algebra< instr_algebra< state_algebra_t > > stepper_algebra_t;
+// The weighted error and its maximum are computed in one pass without temporaries, see gf_error_checker
+template< typename State >
+using cash_karp_stepper_tmpl_t = boost::numeric::odeint::controlled_runge_kutta< boost::numeric::odeint::runge_kutta_cash_karp54< State, double, State, double, stepper_algebra_t, gf_operations >,
+	gf_error_checker< double, stepper_algebra_t, gf_operations > >;
+typedef cash_karp_stepper_tmpl_t< state_t > controlled_stepper_t;
+typedef controlled_stepper_t::stepper_type error_stepper_t;
+
+// Dense-output stepper for observations at given scales, the Dormand-Prince stages provide the interpolation
+// The last step is shortened by the limiter of the step sizes, see integrate_times_checkpointed
+typedef boost::numeric::odeint::runge_kutta_dopri5< state_t, double, state_t, double, stepper_algebra_t, gf_operations > dopri5_stepper_t;
+typedef gf_step_limiter< double, double > step_limiter_t;
+typedef boost::numeric::odeint::dense_output_runge_kutta< boost::numeric::odeint::controlled_runge_kutta< dopri5_stepper_t,
+	gf_error_checker< double, stepper_algebra_t, gf_operations >, step_limiter_t > > dense_stepper_t;
+
+// Linearly implicit stepper for stiff flows, the Jacobian of the rhs is applied by finite differences
+typedef rosenbrock_krylov_t< state_t, stepper_algebra_t > implicit_stepper_t;
+
+// Coarse propagator of the Parareal flow, fixed RK4 steps
+typedef boost::numeric::odeint::runge_kutta4< state_t, double, state_t, double, stepper_algebra_t, gf_operations > coarse_stepper_t;
@@ -0,0 +1,238 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <memory>
+#include <complex>
+#include <cstddef>
+#include <algorithm>
+#include <functional>
+
+#include <boost/multi_array.hpp>
+
+#include <gf.h>
+#include <gf_algebra.h>
+#include <gf_pool.h>
+
+/********************* Symmetry-reduced storage of gf's  ********************/
+
+// Complex conjugation, identity for real values
+inline double gf_conj( const double val ) { return val; }
+template< typename value_t >
+inline std::complex< value_t > gf_conj( const std::complex< value_t >& val ) { return std::conj( val ); }
+
+/**
+ * Table mapping the full frequency grid of a gf onto the irreducible elements with respect to a set of
+ * symmetry operations. A symmetry operation maps an index in place onto an equivalent index and returns
+ * whether the value there is the complex conjugate, e.g. Gam( -W, -w-1 ) = conj( Gam( W, w ) ). Indices
+ * mapped outside of the grid are not related. The representative of each orbit is the element with the
+ * lowest ( row-major ) position, such that the irreducible elements keep the order of the full grid.
+ */
+template< unsigned R >
+class gf_sym_table
+{
+   public:
+      using idx_t = typename gf< std::complex< double >, R >::idx_t;
+      using sym_op_t = std::function< bool( idx_t& idx ) >;
+      using size_type = boost::multi_array_types::size_type;
+      using index = boost::multi_array_types::index;
+
+      gf_sym_table( const boost::detail::multi_array::extent_gen< R >& ext, const std::vector< sym_op_t >& sym_ops ):
+	 num_full_( 1 )
+   {
+      for( unsigned d = 0; d < R; ++d )
+      {
+	 shape_[d] = ext.ranges_[d].size();
+	 index_bases_[d] = ext.ranges_[d].start();
+	 num_full_ *= shape_[d];
+      }
+
+      irr_pos_.assign( num_full_, -1 );
+      conj_.assign( num_full_, false );
+
+      // Collect the orbit of every element not yet assigned, the conjugation is tracked relative to the representative
+      std::vector< int > orbit;
+      for( int pos = 0; pos < int( num_full_ ); ++pos )
+      {
+	 if( irr_pos_[pos] >= 0 )
+	    continue;
+	 const int irr = rep_pos_.size();
+	 rep_pos_.push_back( pos );
+	 irr_pos_[pos] = irr;
+	 orbit.assign( 1, pos );
+	 for( std::size_t i = 0; i < orbit.size(); ++i )
+	    for( const auto& sym_op : sym_ops )
+	    {
+	       idx_t idx = get_idx( orbit[i] );
+	       const bool conj = sym_op( idx ) != conj_[orbit[i]];
+	       if( !in_range( idx ) )
+		  continue;
+	       const int img = get_pos( idx );
+	       if( irr_pos_[img] >= 0 )
+		  continue;
+	       irr_pos_[img] = irr;
+	       conj_[img] = conj;
+	       orbit.push_back( img );
+	    }
+      }
+   }
+
+      size_type num_full() const { return num_full_; } 		///< Number of elements of the full grid
+      size_type num_irr() const { return rep_pos_.size(); } 	///< Number of irreducible elements
+      const size_type* shape() const { return shape_.data(); }
+      const index* index_bases() const { return index_bases_.data(); }
+
+      int irr_pos( const int pos ) const { return irr_pos_[pos]; } 	///< Irreducible element for a position of the full grid
+      bool conj( const int pos ) const { return conj_[pos]; } 		///< Whether the value at pos is the conjugate of the irreducible element
+      int rep_pos( const int irr ) const { return rep_pos_[irr]; } 	///< Position of the representative of an irreducible element
+
+      int get_pos( const idx_t& idx ) const
+      {
+	 int pos = 0;
+	 for( unsigned d = 0; d < R; ++d )
+	    pos = pos * shape_[d] + ( idx[d] - index_bases_[d] );
+	 return pos;
+      }
+
+      idx_t get_idx( int pos ) const
+      {
+	 idx_t idx;
+	 for( int d = R - 1; d >= 0; --d )
+	 {
+	    idx[d] = pos % shape_[d] + index_bases_[d];
+	    pos /= shape_[d];
+	 }
+	 return idx;
+      }
+
+   private:
+      bool in_range( const idx_t& idx ) const
+      {
+	 for( unsigned d = 0; d < R; ++d )
+	    if( idx[d] < index_bases_[d] || idx[d] >= index_bases_[d] + index( shape_[d] ) )
+	       return false;
+	 return true;
+      }
+
+      std::array< size_type, R > shape_;
+      std::array< index, R > index_bases_;
+      size_type num_full_;
+      std::vector< int > irr_pos_;
+      std::vector< bool > conj_;
+      std::vector< int > rep_pos_;
+};
+
+/**
+ * gf storing only the irreducible elements of a gf_sym_table. Reads by ( full ) index or flat position
+ * are mapped through the table, conjugating where necessary. data() and num_elements() refer to the
+ * irreducible storage, such that the gf_algebra, the expression templates and the norms work on the
+ * reduced data ( the symmetries commute with real linear combinations and magnitudes ). init and
+ * init_parallel only evaluate the irreducible elements. The table is shared between all copies.
+ */
+template< typename value_t_, unsigned R >
+class gf_sym
+{
+   public:
+      static constexpr std::size_t dimensionality = R;
+      using value_t = value_t_;
+      using element = value_t;
+      using table_t = gf_sym_table< R >;
+      using idx_t = typename table_t::idx_t;
+      using size_type = typename table_t::size_type;
+      using index = typename table_t::index;
+
+      gf_sym( const std::shared_ptr< const table_t >& table ):
+	 table_( table ), data_( table->num_irr(), value_t( 0.0 ) )
+   {}
+
+      size_type num_elements() const { return data_.size(); }
+      value_t* data() { return data_.data(); }
+      const value_t* data() const { return data_.data(); }
+
+      // Extents of the full grid
+      const size_type* shape() const { return table_->shape(); }
+      const index* index_bases() const { return table_->index_bases(); }
+      const table_t& table() const { return *table_; }
+
+      // Read access to the full grid, by flat position and by index
+      value_t operator()( const int pos ) const
+      {
+	 const value_t& val = data_[ table_->irr_pos( pos ) ];
+	 return table_->conj( pos ) ? gf_conj( val ) : val;
+      }
+      value_t operator()( const idx_t& idx ) const { return (*this)( table_->get_pos( idx ) ); }
+
+      // Write access to the full grid, all symmetry related elements change accordingly
+      void set( const idx_t& idx, const value_t& val )
+      {
+	 const int pos = table_->get_pos( idx );
+	 data_[ table_->irr_pos( pos ) ] = table_->conj( pos ) ? gf_conj( val ) : val;
+      }
+
+      // Irreducible elements and the index of their representative
+      value_t& irr( const int k ) { return data_[k]; }
+      const value_t& irr( const int k ) const { return data_[k]; }
+      idx_t irr_idx( const int k ) const { return table_->get_idx( table_->rep_pos( k ) ); }
+
+      idx_t get_idx( const int pos ) const { return table_->get_idx( pos ); }
+
+      void init( std::function< value_t( const idx_t& idx ) > init_func )
+      {
+	 for( int k = 0; k < int( data_.size() ); ++k )
+	    data_[k] = init_func( irr_idx( k ) );
+      }
+
+      template< typename init_func_t >
+      void init_parallel( const init_func_t& init_func )
+      {
+	 const int n = data_.size();
+#pragma omp parallel for schedule( runtime )
+	 for( int k = 0; k < n; ++k )
+	    data_[k] = init_func( irr_idx( k ) );
+      }
+
+      gf_sym& operator+=( const gf_sym& rhs )
+      {
+	 for( size_type k = 0; k < data_.size(); ++k )
+	    data_[k] += rhs.data_[k];
+	 return *this;
+      }
+
+      gf_sym& operator-=( const gf_sym& rhs )
+      {
+	 for( size_type k = 0; k < data_.size(); ++k )
+	    data_[k] -= rhs.data_[k];
+	 return *this;
+      }
+
+      // Only real scalars preserve the conjugation symmetry
+      gf_sym& operator+=( const double rhs )
+      {
+	 for( auto& val : data_ )
+	    val += rhs;
+	 return *this;
+      }
+
+      gf_sym& operator*=( const double rhs )
+      {
+	 for( auto& val : data_ )
+	    val *= rhs;
+	 return *this;
+      }
+
+      gf_sym& operator/=( const double rhs ) { return *this *= 1.0 / rhs; }
+
+   private:
+      std::shared_ptr< const table_t > table_;
+      std::vector< value_t, gf_pool_allocator< value_t > > data_;
+};
+
+// Maximum norm, the symmetry related elements share the magnitude of their irreducible element
+template< typename value_t, unsigned R >
+double norm( const gf_sym< value_t, R >& gf_obj )
+{
+   double res = 0.0;
+   for( std::size_t k = 0; k < gf_obj.num_elements(); ++k )
+      res = std::max( res, gf_elem_abs2( gf_obj.data()[k] ) );
+   return std::sqrt( res );
+}
@@ -0,0 +1,304 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+#include <cstdlib>
+#include <ostream>
+#include <stdexcept>
+
+/********************* Runtime parameters of the flow  ********************/
+
+/**
+ * Physical and numerical parameters, read from the command line
+ *
+ *   bin/run [ G_L D U E Phi B beta fname err ] [ --key=value ... ] [ --restart ]
+ *
+ * The positional arguments follow the order of calc.sh ( Phi in units of Pi ), err sets both the
+ * absolute and the relative error tolerance. Options: --N, --N_eff, --N_sparse, --err_abs, --err_rel,
+ * --lam_start, --lam_fin, --init_step, --chk, --chk_interval, --trj, --trj_stride, --trj_buffer, --report,
+ * --report_period, --trace and the physical parameters by name. Checkpoints are only written with --chk, the trajectory is only recorded with --trj. --N_eff and --N_sparse only apply to
+ * builds with the compressed frequency grids ( GF_GRID ).
+ *
+ * Sweeps: --sweep=key:v1,v2,... ( repeatable ) runs the flows of all combinations of the values,
+ * --threads sets the number of concurrent flows.
+ *
+ * Output scales: --out_scales=l1,l2,... ( ascending ) integrates with the dense-output stepper and
+ * observes the state at these scales by interpolation instead of after every step.
+ *
+ * Stiff flows: --stepper=rosenbrock replaces the Cash-Karp stepper by the linearly implicit stepper of
+ * gf_implicit.h, --krylov_dim sets the size of its Krylov basis. Sweeps always use Cash-Karp.
+ *
+ * Multilevel flows: --levels=N1,N2,... ( ascending, below N ) integrates the beginning of the flow with
+ * fewer frequencies. The state is prolonged onto the next level once the tail of Gam deviates from its
+ * asymptotic form by more than --tail_tol. Not applied on restarts, which continue at N.
+ *
+ * Parareal: --parareal=S integrates the flow on S slices of the scale concurrently ( see gf_parareal.h ),
+ * predicted by --parareal_coarse_steps RK4 steps per slice and corrected by Cash-Karp integrations of the
+ * slices until the correction is within err_abs and err_rel. Single MPI rank, no output scales. The checkpoint
+ * is written at the end, the trajectory records the initial and the final state.
+ *
+ * Out-of-core vertex: builds with GF_MMAP store Gam in memory-mapped files in --mmap_dir.
+ *
+ * OpenMP: --schedule=static|dynamic|guided|auto and --schedule_chunk set the schedule of the parallel gf
+ * loops ( see gf_parallel.h ), without --schedule the environment variable OMP_SCHEDULE applies.
+ */
+struct params_t
+{
+   // Physical parameters
+   double G_L = 0.5; 			///< Hybridization of the leads
+   double D = 10.0; 			///< Bandwidth
+   double U = 3.0; 			///< Interaction
+   double E = 0.0; 			///< Level energy
+   double Phi = 0.1; 			///< Magnetic flux in units of Pi
+   double B = 0.0; 			///< Magnetic field
+   double beta = 10.0; 			///< Inverse temperature
+
+   // Numerical parameters
+   int N = 100; 			///< Number of Matsubara frequencies
+   int N_eff = 0; 			///< Effective frequency cutoff of the compressed grids ( GF_GRID ), at most N: no sparse frequencies
+   int N_sparse = 32; 			///< Sparse frequencies beyond the dense window of N frequencies ( GF_GRID )
+   double err_abs = 0.01; 		///< Absolute error tolerance of the controlled stepper
+   double err_rel = 0.01; 		///< Relative error tolerance of the controlled stepper
+   double lam_start = 0.0; 		///< Initial flow parameter
+   double lam_fin = 1.0; 		///< Final flow parameter
+   double init_step = 0.1; 		///< Initial step size
+   std::string stepper = "cash_karp"; 	///< Stepper of the flow, cash_karp or rosenbrock
+   int krylov_dim = 10; 		///< Krylov basis of the GMRES solver of the rosenbrock stepper
+   std::vector< int > levels; 		///< Numbers of frequencies of the coarse levels, empty: single level
+   double tail_tol = 1e-2; 		///< Relative deviation of the tail of Gam triggering the next level
+   std::string mmap_dir; 		///< Directory of the files backing the out-of-core vertex ( GF_MMAP ), empty: TMPDIR or /tmp
+   std::string schedule; 		///< Schedule of the parallel gf loops, static, dynamic, guided or auto, empty: OMP_SCHEDULE
+   int schedule_chunk = 0; 		///< Chunk size of the schedule, 0: OpenMP default
+
+   // Output
+   std::string fname = "dat.dat"; 	///< Output file, base name for the reports
+   std::string chk; 			///< Checkpoint file, empty: no checkpoints written
+   int chk_interval = 10; 		///< Checkpoint every chk_interval accepted steps
+   std::string trj; 			///< Trajectory file, empty: no trajectory recorded
+   int trj_stride = 1; 			///< Record every trj_stride observer calls
+   double trj_buffer = 256.0; 		///< Memory budget of the snapshots buffered for the trajectory writer in MB
+   bool restart = false; 		///< Continue from the checkpoint
+   std::vector< double > out_scales; 	///< Scales observed by interpolation, empty: observe every step
+   std::string report; 			///< Instrumentation report ( JSON lines ), default fname with extension .instr.json
+   double report_period = 1.0; 		///< Seconds between the reports
+   std::string trace; 			///< Chrome trace-event file, empty: no trace recorded
+
+   // Parameter sweep
+   std::vector< std::pair< std::string, std::vector< double > > > sweep; 	///< Swept parameters and their values
+   int threads = 0; 			///< Concurrent flows of a sweep, 0: number of hardware threads
+
+   // Parallel in time
+   int parareal = 0; 			///< Slices of the Parareal flow, integrated concurrently on threads workers, 0: sequential flow
+   int parareal_coarse_steps = 2; 	///< RK4 steps per slice of the coarse propagator
+};
+
+namespace params_detail {
+
+   inline double to_double( const std::string& key, const std::string& val )
+   {
+      char* end = nullptr;
+      const double res = std::strtod( val.c_str(), &end );
+      if( val.empty() || *end != '\0' )
+	 throw std::invalid_argument( "invalid value '" + val + "' for " + key );
+      return res;
+   }
+
+   inline int to_int( const std::string& key, const std::string& val )
+   {
+      char* end = nullptr;
+      const long res = std::strtol( val.c_str(), &end, 10 );
+      if( val.empty() || *end != '\0' )
+	 throw std::invalid_argument( "invalid value '" + val + "' for " + key );
+      return res;
+   }
+
+   inline std::string with_extension( const std::string& fname, const std::string& ext )
+   {
+      const std::size_t dot = fname.find_last_of( '.' );
+      const std::size_t slash = fname.find_last_of( '/' );
+      if( dot == std::string::npos || ( slash != std::string::npos && dot < slash ) )
+	 return fname + ext;
+      return fname.substr( 0, dot ) + ext;
+   }
+
+   inline std::vector< double > to_doubles( const std::string& key, const std::string& val )
+   {
+      std::vector< double > res;
+      std::size_t start = 0;
+      for( ;; )
+      {
+	 const std::size_t comma = val.find( ',', start );
+	 res.push_back( to_double( key, val.substr( start, comma - start ) ) );
+	 if( comma == std::string::npos )
+	    return res;
+	 start = comma + 1;
+      }
+   }
+
+   inline std::vector< int > to_ints( const std::string& key, const std::string& val )
+   {
+      std::vector< int > res;
+      std::size_t start = 0;
+      for( ;; )
+      {
+	 const std::size_t comma = val.find( ',', start );
+	 res.push_back( to_int( key, val.substr( start, comma - start ) ) );
+	 if( comma == std::string::npos )
+	    return res;
+	 start = comma + 1;
+      }
+   }
+
+} // namespace params_detail
+
+// Physical or numerical parameter by name, nullptr for unknown names
+inline double* param_ptr( params_t& par, const std::string& key )
+{
+   if( key == "G_L" ) return &par.G_L;
+   if( key == "D" ) return &par.D;
+   if( key == "U" ) return &par.U;
+   if( key == "E" ) return &par.E;
+   if( key == "Phi" ) return &par.Phi;
+   if( key == "B" ) return &par.B;
+   if( key == "beta" ) return &par.beta;
+   if( key == "err_abs" ) return &par.err_abs;
+   if( key == "err_rel" ) return &par.err_rel;
+   if( key == "lam_start" ) return &par.lam_start;
+   if( key == "lam_fin" ) return &par.lam_fin;
+   if( key == "init_step" ) return &par.init_step;
+   return nullptr;
+}
+
+// Parse the command line, throws std::invalid_argument for unknown options or malformed values
+inline params_t parse_params( const int argc, const char* const* argv )
+{
+   using namespace params_detail;
+   params_t par;
+
+   std::vector< double* > positional_dbl = { &par.G_L, &par.D, &par.U, &par.E, &par.Phi, &par.B, &par.beta };
+   const char* positional_names[] = { "G_L", "D", "U", "E", "Phi", "B", "beta", "fname", "err" };
+   int n_positional = 0;
+
+   for( int i = 1; i < argc; ++i )
+   {
+      const std::string arg( argv[i] );
+      if( arg.compare( 0, 2, "--" ) != 0 )
+      {
+	 const std::string key = n_positional < 9 ? positional_names[n_positional] : "";
+	 if( n_positional < 7 )
+	    *positional_dbl[n_positional] = to_double( key, arg );
+	 else if( n_positional == 7 )
+	    par.fname = arg;
+	 else if( n_positional == 8 )
+	    par.err_abs = par.err_rel = to_double( key, arg );
+	 else
+	    throw std::invalid_argument( "too many arguments: " + arg );
+	 ++n_positional;
+	 continue;
+      }
+
+      if( arg == "--restart" )
+      {
+	 par.restart = true;
+	 continue;
+      }
+
+      const std::size_t eq = arg.find( '=' );
+      if( eq == std::string::npos )
+	 throw std::invalid_argument( "missing value for option " + arg );
+      const std::string key = arg.substr( 2, eq - 2 );
+      const std::string val = arg.substr( eq + 1 );
+
+      if( double* p = param_ptr( par, key ) ) *p = to_double( key, val );
+      else if( key == "N" ) par.N = to_int( key, val );
+      else if( key == "N_eff" ) par.N_eff = to_int( key, val );
+      else if( key == "N_sparse" ) par.N_sparse = to_int( key, val );
+      else if( key == "fname" ) par.fname = val;
+      else if( key == "chk" ) par.chk = val;
+      else if( key == "chk_interval" ) par.chk_interval = to_int( key, val );
+      else if( key == "trj" ) par.trj = val;
+      else if( key == "trj_stride" ) par.trj_stride = to_int( key, val );
+      else if( key == "trj_buffer" ) par.trj_buffer = to_double( key, val );
+      else if( key == "report" ) par.report = val;
+      else if( key == "report_period" ) par.report_period = to_double( key, val );
+      else if( key == "trace" ) par.trace = val;
+      else if( key == "out_scales" ) par.out_scales = to_doubles( key, val );
+      else if( key == "stepper" ) par.stepper = val;
+      else if( key == "krylov_dim" ) par.krylov_dim = to_int( key, val );
+      else if( key == "levels" ) par.levels = to_ints( key, val );
+      else if( key == "tail_tol" ) par.tail_tol = to_double( key, val );
+      else if( key == "mmap_dir" ) par.mmap_dir = val;
+      else if( key == "schedule" ) par.schedule = val;
+      else if( key == "schedule_chunk" ) par.schedule_chunk = to_int( key, val );
+      else if( key == "threads" ) par.threads = to_int( key, val );
+      else if( key == "parareal" ) par.parareal = to_int( key, val );
+      else if( key == "parareal_coarse_steps" ) par.parareal_coarse_steps = to_int( key, val );
+      else if( key == "sweep" )
+      {
+	 const std::size_t colon = val.find( ':' );
+	 const std::string name = val.substr( 0, colon );
+	 if( colon == std::string::npos || param_ptr( par, name ) == nullptr )
+	    throw std::invalid_argument( "invalid sweep '" + val + "', expected --sweep=key:v1,v2,... with a physical or numerical parameter" );
+	 par.sweep.emplace_back( name, to_doubles( name, val.substr( colon + 1 ) ) );
+      }
+      else
+	 throw std::invalid_argument( "unknown option --" + key );
+   }
+
+   if( par.N <= 0 )
+      throw std::invalid_argument( "N has to be positive" );
+   if( par.N_sparse < 0 )
+      throw std::invalid_argument( "N_sparse can not be negative" );
+   if( par.stepper != "cash_karp" && par.stepper != "rosenbrock" )
+      throw std::invalid_argument( "unknown stepper " + par.stepper + ", expected cash_karp or rosenbrock" );
+   if( par.stepper == "rosenbrock" && !par.out_scales.empty() )
+      throw std::invalid_argument( "out_scales require the cash_karp stepper" );
+   for( std::size_t i = 0; i < par.levels.size(); ++i )
+      if( par.levels[i] <= ( i > 0 ? par.levels[i - 1] : 0 ) || par.levels[i] >= par.N )
+	 throw std::invalid_argument( "levels have to be positive, ascending and below N" );
+   if( par.parareal < 0 || par.parareal_coarse_steps <= 0 )
+      throw std::invalid_argument( "parareal can not be negative, parareal_coarse_steps has to be positive" );
+   if( par.parareal > 0 && ( par.stepper != "cash_karp" || !par.out_scales.empty() ) )
+      throw std::invalid_argument( "parareal requires the cash_karp stepper without out_scales" );
+   if( !par.schedule.empty() && par.schedule != "static" && par.schedule != "dynamic" && par.schedule != "guided" && par.schedule != "auto" )
+      throw std::invalid_argument( "unknown schedule " + par.schedule + ", expected static, dynamic, guided or auto" );
+   if( par.schedule_chunk < 0 )
+      throw std::invalid_argument( "schedule_chunk can not be negative" );
+   if( par.krylov_dim <= 0 )
+      throw std::invalid_argument( "krylov_dim has to be positive" );
+   for( std::size_t i = 1; i < par.out_scales.size(); ++i )
+      if( par.out_scales[i] <= par.out_scales[i - 1] )
+	 throw std::invalid_argument( "out_scales have to be ascending" );
+   if( par.restart && par.chk.empty() )
+      throw std::invalid_argument( "restart requires the checkpoint file --chk" );
+   if( par.trj_buffer < 0.0 )
+      throw std::invalid_argument( "trj_buffer can not be negative" );
+   if( par.report.empty() )
+      par.report = with_extension( par.fname, ".instr.json" );
+   return par;
+}
+
+// All combinations of the swept values, the last swept parameter varies fastest
+inline std::vector< params_t > sweep_grid( const params_t& par )
+{
+   std::vector< params_t > grid( 1, par );
+   for( const auto& sweep : par.sweep )
+   {
+      std::vector< params_t > next;
+      for( const params_t& point : grid )
+	 for( const double val : sweep.second )
+	 {
+	    next.push_back( point );
+	    *param_ptr( next.back(), sweep.first ) = val;
+	 }
+      grid.swap( next );
+   }
+   return grid;
+}
+
+inline std::ostream& operator<<( std::ostream& os, const params_t& par )
+{
+   return os << " G_L " << par.G_L << " D " << par.D << " U " << par.U << " E " << par.E << " Phi " << par.Phi << " Pi B " << par.B
+      << " beta " << par.beta << " N " << par.N << " err_abs " << par.err_abs << " err_rel " << par.err_rel;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include <exception>
+
+/********************* Work-stealing execution of independent tasks  ********************/
+
+namespace ws_detail {
+
+   // Task queue of one worker, the owner takes from the back, thieves from the front
+   class task_queue_t
+   {
+      public:
+	 void push( const std::size_t task )
+	 {
+	    std::lock_guard< std::mutex > lock( mutex_ );
+	    tasks_.push_back( task );
+	 }
+
+	 bool pop( std::size_t& task )
+	 {
+	    std::lock_guard< std::mutex > lock( mutex_ );
+	    if( tasks_.empty() )
+	       return false;
+	    task = tasks_.back();
+	    tasks_.pop_back();
+	    return true;
+	 }
+
+	 bool steal( std::size_t& task )
+	 {
+	    std::lock_guard< std::mutex > lock( mutex_ );
+	    if( tasks_.empty() )
+	       return false;
+	    task = tasks_.front();
+	    tasks_.pop_front();
+	    return true;
+	 }
+
+      private:
+	 std::mutex mutex_;
+	 std::deque< std::size_t > tasks_;
+   };
+
+} // namespace ws_detail
+
+// Number of workers for a requested count, 0 or less: number of hardware threads
+inline int ws_num_workers( const int requested )
+{
+   if( requested > 0 )
+      return requested;
+   const int hw = std::thread::hardware_concurrency();
+   return hw > 0 ? hw : 1;
+}
+
+/**
+ * Executes task( i, worker ) for all i in [ 0, num_tasks ) on num_workers threads and returns when all
+ * tasks are done. The tasks are initially split into contiguous blocks, one per worker. A worker whose
+ * queue runs empty steals the oldest remaining task of another worker, such that tasks of very different
+ * duration keep all workers busy. worker identifies the executing thread ( 0 <= worker < num_workers ),
+ * e.g. to use per-worker buffers. The first exception thrown by a task is rethrown after all workers
+ * finished, the remaining tasks are skipped.
+ */
+template< typename Task >
+void work_stealing_for( const std::size_t num_tasks, const int num_workers, const Task& task )
+{
+   const int n_workers = num_workers > 0 ? num_workers : 1;
+   std::vector< ws_detail::task_queue_t > queues( n_workers );
+
+   // Owners pop from the back, hence the blocks are pushed in reverse order to be processed in ascending order
+   for( std::size_t i = num_tasks; i-- > 0; )
+      queues[ i * n_workers / num_tasks ].push( i );
+
+   std::atomic< bool > failed( false );
+   std::exception_ptr error;
+   std::mutex error_mutex;
+
+   auto work = [&]( const int worker )
+   {
+      std::size_t t;
+      for( ;; )
+      {
+	 bool found = queues[worker].pop( t );
+	 for( int k = 1; !found && k < n_workers; ++k )
+	    found = queues[ ( worker + k ) % n_workers ].steal( t );
+	 if( !found || failed.load( std::memory_order_relaxed ) )
+	    return;
+	 try
+	 {
+	    task( t, worker );
+	 }
+	 catch( ... )
+	 {
+	    std::lock_guard< std::mutex > lock( error_mutex );
+	    if( !failed.exchange( true ) )
+	       error = std::current_exception();
+	 }
+      }
+   };
+
+   std::vector< std::thread > threads;
+   for( int w = 1; w < n_workers; ++w )
+      threads.emplace_back( work, w );
+   work( 0 );
+   for( auto& thread : threads )
+      thread.join();
+
+   if( error )
+      std::rethrow_exception( error );
+}
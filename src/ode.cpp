@@ -1,149 +1,417 @@
 #include <iostream>
+#include <fstream>
 #include <complex>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <array>
 
 #include <boost/numeric/odeint.hpp>
 
-#include <arithmetic_tuple.h>
-#include <gf.h>
+#include <gf_state.h>
+#include <gf_checkpoint.h>
+#include <gf_observer.h>
+#include <params.h>
+#include <gf_parareal.h>
+#include <work_stealing.h>
 
 using namespace ReaK; 
-using dcomplex = std::complex< double >; 
-
-const int N=100;//number of Matsubara frequencies
-
-#define INSERT_COPY_AND_ASSIGN(X) 					\
-X( const X & obj ):    							\
-   base_t( obj )							\
-{}       								\
-X( X && obj ):								\
-   base_t( std::move(obj) )						\
-{}      								\
-X & operator=( const X & obj )						\
-{									\
-   base_t::operator=( obj ); 						\
-   return *this; 							\
-} 									\
-X & operator=( X && obj )						\
-{									\
-   base_t::operator=( std::move( obj ) ); 				\
-   return *this; 							\
-} 
-
-enum class I1P{ w }; 
-class gf_1p_t : public gf< dcomplex, 1 > 		///< Container type for one-particle correlation function
-{
-   public:
-      using base_t = gf< dcomplex, 1 >; 
 
-      gf_1p_t():
-	 gf< dcomplex, 1 >( boost::extents[ffreq(N)] )
+// State, storage and stepper types of the flow, shared with the benchmarks, see gf_state.h
+int N = 100; //number of Matsubara frequencies, set from the command line before any gf is created
+int N_eff = 100; //effective cutoff of the compressed frequency grids ( GF_GRID )
+int N_sparse = 0; //sparse frequencies beyond the dense window of N frequencies ( GF_GRID )
+
+// The rhs of x' = f(x) defined as a class 
+class rhs_t{
+   public:
+      rhs_t( const params_t& par_ ):
+	 par( par_ )
    {}
-      INSERT_COPY_AND_ASSIGN(gf_1p_t)
-}; 
-using idx_1p_t = gf_1p_t::idx_t; 
 
-enum class I2P{ W, w }; 
-class gf_2p_t : public gf< dcomplex, 2 > 		///< Container type for two-particle correlation functions
+      const params_t& par; 	///< Physical parameters of the flow
+
+      void operator()( const state_t &x , state_t &dxdt , const double  t  )
+      {
+	 // Evaluations, their timing and the current scale are reported by the instrumentation, see gf_instr.h
+	 instr_scope_t scope( instr_region::RHS ); 
+	 instr_add( instr_count::RHS_EVALS ); 
+	 instr_set_scale( t ); 
+
+	 // Frequency grids are distributed over the OpenMP threads, see gf_parallel.h
+	 // Each MPI rank computes the Gam for its own slab of bosonic frequencies
+	 // The vertex is computed in cache-sized tiles, quantities depending on W only once per row of a tile
+	 init_parallel( dxdt.Sig(), []( const idx_1p_t& )->double{ return 1.0; } );
+	 init_tiles( dxdt.Gam(), []( const tile_2p_t& tile )
+	       {
+		  for( int i = 0; i < tile.n_W; ++i )
+		     for( int j = 0; j < tile.n_w; ++j )
+			tile( i, j ) = 1.0;
+	       } );
+      }
+};
+
+// Initial condition of the flow
+void init_state( state_t& x, const params_t& )
 {
-   public:
-      using base_t = gf< dcomplex, 2 >; 
+   x.Sig().init( []( const idx_1p_t& )->double{ return 1.1; } );
+   init_rows( x.Gam(), []( const row_2p_t& row )
+	 {
+	    for( int j = 0; j < row.len; ++j )
+	       row[j] = 1.2;
+	 } );
+}
 
-      gf_2p_t():
-	 gf< dcomplex, 2 >( boost::extents[bfreq(N)][ffreq(N)] )
-   {}
-      INSERT_COPY_AND_ASSIGN(gf_2p_t)
-}; 
-using idx_2p_t = gf_2p_t::idx_t; 
+// Prolongation of a state of N_coarse frequencies onto the current N, frequencies beyond the coarse grid are
+// extrapolated with the asymptotic tails of gf_grid.h
+void prolong( const state_t& coarse, state_t& fine, const int N_coarse )
+{
+#ifdef GF_GRID
+   (void)N_coarse; 
+   fine.Sig().init( [&]( const idx_1p_t& idx )->dcomplex{ return coarse.Sig()( idx ); } );
+   fine.Gam().init( [&]( const idx_2p_t& idx )->Gam_value_t{ return coarse.Gam()( idx ); } );
+#else
+   const freq_grid_t w_box( true, N_coarse, N_coarse, 0 ), W_box( false, N_coarse, N_coarse, 0 ); 
+   fine.Sig().init( [&]( const idx_1p_t& idx )->dcomplex{ return gf_interp( coarse.Sig(), std::array< const freq_grid_t*, 1 >{{ &w_box }}, idx ); } );
+   fine.Gam().init( [&]( const idx_2p_t& idx )->Gam_value_t{ return gf_interp( coarse.Gam(), std::array< const freq_grid_t*, 2 >{{ &W_box, &w_box }}, idx ); } );
+#endif
+}
 
-// The state type for the Ode solver, tuple of gf's with arithmetic operations
-class state_t: public arithmetic_tuple< gf_1p_t, gf_2p_t > 
+/**
+ * Coarse levels of a multilevel flow. Starting at lam, the flow is integrated with the numbers of frequencies
+ * par.levels and prolonged onto the next level as soon as the tail of Gam deviates from its asymptotic form
+ * by more than par.tail_tol ( gf_tail_deviation ). On return, x holds the flow of the last coarse level
+ * prolonged onto the full N, at the returned scale. The final level continues from there.
+ */
+double multilevel_flow( const params_t& par, state_t& x, double lam, double& step )
 {
-   public:
-      using base_t = arithmetic_tuple< gf_1p_t, gf_2p_t >; 
-      using Sig_t = gf_1p_t; 
-      using Gam_t = gf_2p_t; 
+   const int N_full = N; 
+   std::unique_ptr< state_t > coarse; 
+   int N_coarse = 0; 
+   for( const int N_level : par.levels )
+   {
+      N = N_level; 
+      std::unique_ptr< state_t > level( new state_t ); 
+      if( coarse )
+	 prolong( *coarse, *level, N_coarse ); 
+      else
+	 init_state( *level, par ); 
 
-      inline Sig_t& Sig() { return( std::get<0>( *this ) ); } 
-      inline const Sig_t& Sig() const { return( std::get<0>( *this ) ); }
+      controlled_stepper_t stepper( controlled_stepper_t::error_checker_type( par.err_abs, par.err_rel ) ); 
+      rhs_t rhs( par ); 
+      std::size_t steps = 0; 
+      while( lam < par.lam_fin && gf_tail_deviation( level->Gam() ) <= par.tail_tol )
+      {
+	 if( lam + step > par.lam_fin )
+	    step = par.lam_fin - lam; 
+	 controlled_step( stepper, rhs, *level, lam, step ); 
+	 ++steps; 
+      }
+      if( mpi_is_root() )
+	 std::cout << " Level N = " << N_level << ": " << steps << " steps up to scale " << lam << std::endl; 
 
-      inline Gam_t& Gam() { return( std::get<1>( *this ) ); } 
-      inline const Gam_t& Gam() const { return( std::get<1>( *this ) ); }
+      coarse = std::move( level ); 
+      N_coarse = N_level; 
+   }
+   N = N_full; 
+   if( coarse )
+      prolong( *coarse, x, N_coarse ); 
+   coarse.reset(); 
+   gf_pool::instance().trim(); 	// The extents of the coarse levels are not requested again
+   return lam; 
+}
 
-      state_t():
-	 base_t()
-   {}
-      INSERT_COPY_AND_ASSIGN(state_t)
-}; 
+/**
+ * Parareal flow from lam to par.lam_fin on par.parareal slices ( gf_parareal.h ). The coarse propagator takes
+ * par.parareal_coarse_steps RK4 steps per slice, the fine propagator integrates a slice with the controlled
+ * Cash-Karp stepper of the sequential flow, its steps are counted by the instrumentation like those of the
+ * sequential flow. The fine integrations run concurrently on the work-stealing workers, each with its own
+ * stepper and rhs and without nested OpenMP teams, the coarse sweeps between them use all threads. Returns
+ * the Parareal iterations.
+ */
+parareal_stats_t parareal_flow( const params_t& par, state_t& x, const double lam )
+{
+   using namespace boost::numeric::odeint; 
 
-// Norm of state_t, needed for adaptive stepping routines
-namespace boost { namespace numeric { namespace odeint {
-   template<>
-      struct vector_space_norm_inf< state_t >
+   struct worker_t
+   {
+      std::unique_ptr< controlled_stepper_t > stepper; 
+      std::unique_ptr< rhs_t > rhs; 
+   }; 
+   const int num_workers = std::min( ws_num_workers( par.threads ), par.parareal ); 
+   std::vector< worker_t > workers( num_workers ); 
+
+   coarse_stepper_t coarse_stepper; 
+   rhs_t coarse_rhs( par ); 
+   auto coarse = [&]( state_t& s, const double ta, const double tb )
+   {
+      const int n = par.parareal_coarse_steps; 
+      const double dt = ( tb - ta ) / n; 
+      for( int i = 0; i < n; ++i )
+	 coarse_stepper.do_step( coarse_rhs, s, ta + i * dt, dt ); 
+   }; 
+
+   auto fine = [&]( state_t& s, const double ta, const double tb, const int w )
+   {
+      worker_t& worker = workers[w]; 
+      if( !worker.stepper )
       {
-	 typedef double result_type;
-	 double operator()( const state_t &p ) const
+	 worker.stepper.reset( new controlled_stepper_t( controlled_stepper_t::error_checker_type( par.err_abs, par.err_rel ) ) ); 
+	 worker.rhs.reset( new rhs_t( par ) ); 
+      }
+      const int threads = gf_num_threads(); 	// Worker 0 is the calling thread, which runs the coarse sweeps afterwards
+      set_gf_num_threads( 1 ); 
+      double t = ta, dt = std::min( par.init_step, tb - ta ); 
+      while( t < tb )
+      {
+	 if( t + dt > tb )
+	    dt = tb - t; 
+	 controlled_step( *worker.stepper, *worker.rhs, s, t, dt ); 
+      }
+      set_gf_num_threads( threads ); 
+   }; 
+
+   return parareal( coarse, fine, x, lam, par.lam_fin, par.parareal, num_workers, par.err_abs, par.err_rel ); 
+}
+
+// Result of one flow of a sweep
+struct sweep_result_t
+{
+   std::size_t steps; 
+   dcomplex Gam0; 
+   double norm; 
+}; 
+
+// Independent flows of the parameter grid, executed concurrently with work stealing. Each worker integrates its
+// flows in its own state and stepper, such that the buffers are only allocated once per worker
+void sweep_flows( const std::vector< params_t >& grid, const int num_workers, std::vector< sweep_result_t >& results )
+{
+   using namespace boost::numeric::odeint; 
+
+   struct worker_t
+   {
+      state_t x; 
+      std::unique_ptr< controlled_stepper_t > stepper; 
+      double err_abs = -1.0, err_rel = -1.0; 
+   }; 
+   std::vector< worker_t > workers( num_workers ); 
+
+   work_stealing_for( grid.size(), num_workers, [&]( const std::size_t i, const int w )
 	 {
-	    using namespace std; 
-	    return norm( p ); 
-	 }
-      };
-}}}
+	    const params_t& point = grid[i]; 
+	    worker_t& worker = workers[w]; 
+	    set_gf_num_threads( 1 ); 	// The flows are the parallel tasks, no nested OpenMP teams
 
-// The rhs of x' = f(x) defined as a class 
-class rhs_t{
-   public:
-      void operator()( const state_t &x , state_t &dxdt , const double  t  )
-      {
-	 std::cout << " Evaluation at scale " << t << std::endl; 
-	 std::cout << " Tracking Gam0:  " << x.Gam()(0) << std::endl; 
+	    // The error checker is fixed at construction, the stepper is only rebuilt for new tolerances. The old stepper
+	    // is released first, such that the new one draws its buffers from the gf_pool
+	    if( !worker.stepper || worker.err_abs != point.err_abs || worker.err_rel != point.err_rel )
+	    {
+	       worker.stepper.reset(); 
+	       worker.stepper.reset( new controlled_stepper_t( controlled_stepper_t::error_checker_type( point.err_abs, point.err_rel ) ) ); 
+	       worker.err_abs = point.err_abs; 
+	       worker.err_rel = point.err_rel; 
+	    }
 
-	 dxdt.Sig().init( []( const idx_1p_t& idx )->double{ return 1.0; } );
-	 dxdt.Gam().init( []( const idx_2p_t& idx )->double{ return 1.0; } );
-      }
-};
+	    init_state( worker.x, point ); 
+	    rhs_t rhs( point ); 
+	    const std::size_t steps = integrate_adaptive( boost::ref( *worker.stepper ), rhs, worker.x, point.lam_start, point.lam_fin, point.init_step ); 
+	    results[i] = sweep_result_t{ steps, worker.x.Gam()(0), norm( worker.x ) }; 
+	 } ); 
+}
+
+// Flows for all points of the parameter grid, the results are written to a CSV file
+int run_sweep( const params_t& par )
+{
+   if( mpi_size() > 1 )
+   {
+      if( mpi_is_root() )
+	 std::cerr << " Parameter sweeps run on a single MPI rank " << std::endl; 
+      return 1; 
+   }
+
+   const std::vector< params_t > grid = sweep_grid( par ); 
+   const int num_workers = std::min< int >( ws_num_workers( par.threads ), grid.size() ); 
+   std::cout << " Sweep over " << grid.size() << " parameter sets on " << num_workers << " workers" << std::endl; 
+
+   std::vector< sweep_result_t > results( grid.size() ); 
+   sweep_flows( grid, num_workers, results ); 
+
+   // Results keyed by the parameter set, in the order of the grid
+   const std::string fname = params_detail::with_extension( par.fname, ".sweep.csv" ); 
+   std::ofstream out( fname ); 
+   out.precision( 12 ); 
+   out << "G_L,D,U,E,Phi,B,beta,err_abs,err_rel,steps,Gam0_re,Gam0_im,norm" << std::endl; 
+   for( std::size_t i = 0; i < grid.size(); ++i )
+   {
+      const params_t& p = grid[i]; 
+      out << p.G_L << "," << p.D << "," << p.U << "," << p.E << "," << p.Phi << "," << p.B << "," << p.beta << "," << p.err_abs << "," << p.err_rel << "," 
+	 << results[i].steps << "," << results[i].Gam0.real() << "," << results[i].Gam0.imag() << "," << results[i].norm << std::endl; 
+   }
+   std::cout << " Sweep results written to " << fname << std::endl; 
+   std::cout << " gf pool " << gf_pool_stats() << std::endl; 
+   return 0; 
+}
 
 auto my_test( int a ) -> double { return a; }
 
-int main(int /* argc */ , char** /* argv */ )
+int main(int argc , char** argv )
 {
    using namespace boost::numeric::odeint;
    using namespace std; 
 
+   mpi_env_t mpi_env( argc, argv ); 
+
+   params_t par; 
+   try
+   {
+      par = parse_params( argc, argv ); 
+   }
+   catch( const std::invalid_argument& e )
+   {
+      if( mpi_is_root() )
+	 cerr << " " << e.what() << endl << " Usage: " << argv[0] << " [ G_L D U E Phi B beta fname err ] [ --key=value ... ] [ --restart ] [ --sweep=key:v1,v2,... ] [ --out_scales=l1,l2,... ] [ --stepper=rosenbrock ] [ --levels=N1,N2,... ] [ --parareal=S ], see params.h" << endl; 
+      return 1; 
+   }
+   N = par.N;
+   N_eff = std::max( par.N_eff, par.N );
+   N_sparse = par.N_sparse; 
+   set_gf_mmap_dir( par.mmap_dir ); 
+   if( !par.schedule.empty() )
+      set_gf_schedule( par.schedule == "static" ? gf_schedule::STATIC : par.schedule == "dynamic" ? gf_schedule::DYNAMIC 
+	    : par.schedule == "guided" ? gf_schedule::GUIDED : gf_schedule::AUTO, par.schedule_chunk ); 
+
+   if( mpi_is_root() )
+      cout << par << endl; 
+
+   // Periodic reports of the instrumentation, per rank with MPI
+   instr_t::instance().enable_report( mpi_size() > 1 ? par.report + "." + to_string( mpi_rank() ) : par.report, par.report_period ); 
+   if( !par.trace.empty() )
+      instr_t::instance().enable_trace(); 
+
+   if( !par.sweep.empty() )
+      return run_sweep( par ); 
+
+   if( !par.levels.empty() && mpi_size() > 1 )
+   {
+      if( mpi_is_root() )
+	 cerr << " Multilevel flows run on a single MPI rank " << endl; 
+      return 1; 
+   }
+
+   if( par.parareal > 0 && mpi_size() > 1 )
+   {
+      if( mpi_is_root() )
+	 cerr << " Parareal flows run on a single MPI rank " << endl; 
+      return 1; 
+   }
+
    state_t state_vec; 
 
    double a = 10.0; 
 
    // Initialize current state
-   state_vec.Sig().init( []( const idx_1p_t& idx )->double{ return 1.1; } );
-   state_vec.Gam().init( []( const idx_2p_t& idx )->double{ return 1.2; } );
+   init_state( state_vec, par ); 
 
-   cout << " norm( state_vec ) " << norm( state_vec ) << endl; 
+   const double norm_init = mpi_max( norm( state_vec ) ); 
 
-   cout << " Gam0 init " << state_vec.Gam()(0) << endl; 
+   if( mpi_is_root() )
+   {
+      cout << " norm( state_vec ) " << norm_init << endl; 
+      cout << " Gam0 init " << state_vec.Gam()(0) << endl; 
+   }
 
    // Save copies of initial gfs
 
    // Some tests
 
    // instantiate rhs object
-   rhs_t rhs;
-
-   // Type of adaptive stepper, use vector_space_algebra here!
-   typedef runge_kutta_cash_karp54< state_t, double, state_t, double, vector_space_algebra > error_stepper_t; 
+   rhs_t rhs( par );
 
    // Constants
-   double ERR_ABS = 0.01; 
-   double ERR_REL = 0.01; 
+   double ERR_ABS = par.err_abs; 
+   double ERR_REL = par.err_rel; 
 
-   double LAM_START = 0.0; 
-   double LAM_FIN = 1.0; 
-   double INIT_STEP = 0.1; 
+   double LAM_START = par.lam_start; 
+   double LAM_FIN = par.lam_fin; 
+   double INIT_STEP = par.init_step; 
 
-   // Integrate ODE 
-   int steps = integrate_adaptive( make_controlled< error_stepper_t >( ERR_ABS, ERR_REL ), rhs, state_vec, LAM_START, LAM_FIN, INIT_STEP ); 
+   // Checkpoints every chk_interval accepted steps ( --chk ), the flow is continued from the checkpoint with --restart
+   checkpoint_t chk( par.chk, par.chk_interval ); 
+
+   double lam = LAM_START; 
+   double step = INIT_STEP; 
+   std::size_t steps_done = 0; 
+   if( par.restart )
+   {
+      try
+      {
+	 chk.read( state_vec, lam, step, steps_done ); 
+      }
+      catch( const std::runtime_error& e )
+      {
+	 cerr << " Restart failed: " << e.what() << endl; 
+	 return 1; 
+      }
+      if( mpi_is_root() )
+	 cout << " Restart from " << chk.fname() << " at scale " << lam << " after " << steps_done << " steps " << endl; 
+   }
+
+   // Coarse levels of a multilevel flow, the flow at N continues from the prolonged state
+   if( !par.levels.empty() && !par.restart )
+      lam = multilevel_flow( par, state_vec, lam, step ); 
+
+   // Trajectory of the flow ( --trj ), recorded every trj_stride observer calls by a background writer thread
+   std::unique_ptr< trajectory_writer_t< state_t > > trj; 
+   if( !par.trj.empty() )
+      trj.reset( new trajectory_writer_t< state_t >( par.trj, state_vec, par.trj_stride, std::size_t( par.trj_buffer * ( 1 << 20 ) ), par.restart ) ); 
+   const trajectory_writer_t< state_t >::observer_t observer{ trj.get() }; 
+
+   // Integrate ODE, with output scales the state is interpolated there and the steps are not shortened to hit them. The
+   // Parareal flow integrates the slices concurrently, its trajectory holds the initial and the final state and the
+   // checkpoint is written at the end
+   if( par.parareal > 0 )
+   {
+      observer( state_vec, lam ); 
+      const parareal_stats_t pr = parareal_flow( par, state_vec, lam ); 
+      lam = std::max( lam, LAM_FIN ); 
+      observer( state_vec, lam ); 
+      chk.write( state_vec, lam, step, steps_done + instr_t::instance().totals().counts[ size_t( instr_count::STEPS_ACCEPTED ) ] ); 
+      if( mpi_is_root() )
+	 cout << " Parareal: " << pr.iterations << " iterations on " << par.parareal << " slices, correction " << pr.correction 
+	    << ( pr.converged ? "" : ", not converged" ) << endl; 
+   }
+   else if( par.stepper == "rosenbrock" )
+      integrate_checkpointed( implicit_stepper_t( ERR_ABS, ERR_REL, par.krylov_dim ), rhs, state_vec, lam, LAM_FIN, step, chk, steps_done, observer ); 
+   else if( par.out_scales.empty() )
+      integrate_checkpointed( controlled_stepper_t( controlled_stepper_t::error_checker_type( ERR_ABS, ERR_REL ) ), rhs, state_vec, lam, LAM_FIN, step, chk, steps_done, observer ); 
+   else
+   {
+      const step_limiter_t limiter; 
+      integrate_times_checkpointed( dense_stepper_t( dense_stepper_t::controlled_stepper_type( dense_stepper_t::controlled_stepper_type::error_checker_type( ERR_ABS, ERR_REL ), limiter ) ), 
+	    limiter, rhs, state_vec, lam, LAM_FIN, step, par.out_scales.begin(), par.out_scales.end(), chk, steps_done, observer ); 
+   }
+   //int steps = integrate_adaptive( make_controlled< error_stepper_t >( ERR_ABS, ERR_REL ), rhs, state_vec, LAM_START, LAM_FIN, INIT_STEP ); 
    //error_stepper_t stepper; 
    //int steps = integrate_const( stepper, rhs, state_vec, LAM_START, LAM_FIN, INIT_STEP ); 
 
-   // Output results
-   cout << " Gam0 final " << state_vec.Gam()(0) << endl; 
+   if( trj )
+      trj->finish(); 
+   instr_t::instance().report( true ); 
+   if( !par.trace.empty() )
+      instr_t::instance().write_trace( mpi_size() > 1 ? par.trace + "." + to_string( mpi_rank() ) : par.trace ); 
+
+   // Output results, the first slab and thus Gam0 resides on the root rank
+   if( mpi_is_root() )
+   {
+      const instr_totals_t tot = instr_t::instance().totals(); 
+      cout << " Steps " << tot.counts[ size_t( instr_count::STEPS_ACCEPTED ) ] << " accepted, " << tot.counts[ size_t( instr_count::STEPS_REJECTED ) ] << " rejected, " 
+	 << tot.counts[ size_t( instr_count::RHS_EVALS ) ] << " rhs evaluations, " << tot.counts[ size_t( instr_count::LINEAR_ITERS ) ] << " linear iterations " << endl; 
+      cout << " Gam0 final " << state_vec.Gam()(0) << endl; 
+      cout << " gf pool " << gf_pool_stats() << endl; 	// Storage drawn from the gf_pool, see gf_pool.h
+      if( trj && trj->dropped() > 0 )
+	 cout << " Trajectory: " << trj->dropped() << " snapshots dropped " << endl; 
+      if( trj && trj->failed() )
+	 cout << " Trajectory: writing " << trj->fname() << " failed " << endl; 
+   }
 }